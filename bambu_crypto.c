@@ -5,14 +5,26 @@
  */
 
 #include "bambu_crypto.h"
-#include <mbedtls/md.h>
+#include "bambu_sha256.h"
 #include <string.h>
 
+#ifdef BAMBU_CRYPTO_REFERENCE
+#include <mbedtls/md.h>
+
 // Master Key from SpoolEase (reverse-engineered from Bambu Lab)
 static const uint8_t BAMBU_MASTER_KEY[] = {
     0x9a, 0x75, 0x9c, 0xf2, 0xc4, 0xf7, 0xca, 0xff,
     0x22, 0x2c, 0xb9, 0x76, 0x9b, 0x41, 0xbc, 0x96
 };
+#endif
+
+// BAMBU_MASTER_KEY as HMAC ipad/opad states, checked by bambu_crypto_self_test()
+static const BambuHmacKey BAMBU_MASTER_HMAC = {
+    .inner = {0xa68795a1, 0x69588f24, 0xd53934b7, 0x049b04f1,
+              0x67715b33, 0xefe5119f, 0xe6d8d31d, 0xbae4702a},
+    .outer = {0x0e7f0561, 0x0a7c3d7b, 0x28408641, 0x12f63756,
+              0xa950e8c1, 0xe4e34b7d, 0x9c667e60, 0xe3347965},
+};
 
 // Context string for HKDF-Expand (includes null terminator)
 static const uint8_t BAMBU_CONTEXT[] = "RFID-A";
@@ -22,6 +34,13 @@ static const uint8_t BAMBU_CONTEXT[] = "RFID-A";
 #define SHA256_LEN 32
 
 void calculate_all_keys(const uint8_t* uid, size_t uid_len, BambuKeys* keys_out) {
+    BambuKdf kdf;
+    bambu_kdf_init(&kdf, uid, uid_len);
+    bambu_kdf_get_keys(&kdf, BAMBU_NUM_SECTORS, keys_out);
+}
+
+#ifdef BAMBU_CRYPTO_REFERENCE
+void calculate_all_keys_mbedtls(const uint8_t* uid, size_t uid_len, BambuKeys* keys_out) {
     mbedtls_md_context_t ctx;
     uint8_t prk[SHA256_LEN];  // Pseudo-random key from extract phase
 
@@ -81,6 +100,113 @@ void calculate_all_keys(const uint8_t* uid, size_t uid_len, BambuKeys* keys_out)
 
     mbedtls_md_free(&ctx);
 }
+#endif
+
+// ============================================
+// Incremental derivation
+// ============================================
+const BambuHmacKey* bambu_master_hmac(void) {
+    return &BAMBU_MASTER_HMAC;
+}
+
+void bambu_kdf_init(BambuKdf* kdf, const uint8_t* uid, size_t uid_len) {
+    memset(kdf, 0, sizeof(BambuKdf));
+    if(uid_len > BAMBU_UID_MAX_LEN) uid_len = BAMBU_UID_MAX_LEN;
+    memcpy(kdf->uid, uid, uid_len);
+    kdf->uid_len = uid_len;
+}
+
+// Compute expand blocks up to T(count), extracting the PRK first if needed.
+// Every HMAC message fits one block, so extract costs 2 compressions, keying
+// the PRK 2 and each expand block 2. No heap, about 300 bytes of stack.
+static void bambu_kdf_expand(BambuKdf* kdf, uint8_t count) {
+    if(kdf->blocks >= count) return;
+
+    if(kdf->blocks == 0) {
+        uint8_t prk[SHA256_LEN];
+        bambu_hmac_sha256_short(&BAMBU_MASTER_HMAC, kdf->uid, kdf->uid_len, prk);
+        bambu_hmac_sha256_key(&kdf->prk, prk, SHA256_LEN);
+    }
+
+    // T(i) = HMAC(PRK, T(i-1) || context || i), T(i-1) is already in okm
+    uint8_t msg[SHA256_LEN + BAMBU_CONTEXT_LEN + 1];
+    for(uint8_t i = kdf->blocks + 1; i <= count; i++) {
+        size_t len = 0;
+        if(i > 1) {
+            memcpy(msg, &kdf->okm[(i - 2) * SHA256_LEN], SHA256_LEN);
+            len = SHA256_LEN;
+        }
+        memcpy(&msg[len], BAMBU_CONTEXT, BAMBU_CONTEXT_LEN);
+        len += BAMBU_CONTEXT_LEN;
+        msg[len++] = i;
+        bambu_hmac_sha256_short(&kdf->prk, msg, len, &kdf->okm[(i - 1) * SHA256_LEN]);
+    }
+    kdf->blocks = count;
+}
+
+const uint8_t* bambu_kdf_sector_key(BambuKdf* kdf, uint8_t sector) {
+    if(sector >= BAMBU_NUM_SECTORS) sector = BAMBU_NUM_SECTORS - 1;
+
+    // Block holding the last byte of the key
+    bambu_kdf_expand(kdf, (sector * BAMBU_KEY_LENGTH + BAMBU_KEY_LENGTH - 1) / SHA256_LEN + 1);
+    return &kdf->okm[sector * BAMBU_KEY_LENGTH];
+}
+
+uint8_t bambu_kdf_get_keys(BambuKdf* kdf, uint8_t sector_count, BambuKeys* keys_out) {
+    if(sector_count == 0) return 0;
+
+    bambu_kdf_sector_key(kdf, sector_count - 1);
+    uint8_t available = (kdf->blocks * SHA256_LEN) / BAMBU_KEY_LENGTH;
+    if(available > BAMBU_NUM_SECTORS) available = BAMBU_NUM_SECTORS;
+
+    memcpy(keys_out->keys, kdf->okm, available * BAMBU_KEY_LENGTH);
+    return available;
+}
+
+#ifdef BAMBU_CRYPTO_REFERENCE
+// ============================================
+// Self test
+// ============================================
+bool bambu_crypto_self_test(void) {
+    static const uint8_t uids[][7] = {
+        {0x00, 0x00, 0x00, 0x00},
+        {0x75, 0x88, 0x6B, 0x1D},
+        {0xFF, 0xFF, 0xFF, 0xFF},
+        {0x04, 0x3A, 0x5C, 0x22, 0x91, 0x6F, 0x80},
+    };
+    static const uint8_t uid_lens[] = {4, 4, 4, 7};
+    BambuKeys expected;
+    BambuKeys keys;
+    BambuKdf kdf;
+
+    // The precomputed master key states
+    BambuHmacKey master;
+    bambu_hmac_sha256_key(&master, BAMBU_MASTER_KEY, sizeof(BAMBU_MASTER_KEY));
+    if(memcmp(&master, &BAMBU_MASTER_HMAC, sizeof(BambuHmacKey)) != 0) return false;
+
+    for(size_t u = 0; u < sizeof(uid_lens); u++) {
+        calculate_all_keys_mbedtls(uids[u], uid_lens[u], &expected);
+
+        // Sectors 0-4 must take one expand block, the rest come in on demand
+        bambu_kdf_init(&kdf, uids[u], uid_lens[u]);
+        memset(&keys, 0, sizeof(keys));
+        if(bambu_kdf_get_keys(&kdf, 2, &keys) != 5 || kdf.blocks != 1) return false;
+        if(memcmp(keys.keys, expected.keys, 5 * BAMBU_KEY_LENGTH) != 0) return false;
+
+        for(uint8_t sector = 0; sector < BAMBU_NUM_SECTORS; sector++) {
+            if(memcmp(bambu_kdf_sector_key(&kdf, sector), expected.keys[sector], BAMBU_KEY_LENGTH) !=
+               0) {
+                return false;
+            }
+        }
+
+        // All blocks in one go
+        calculate_all_keys(uids[u], uid_lens[u], &keys);
+        if(memcmp(&keys, &expected, sizeof(BambuKeys)) != 0) return false;
+    }
+    return true;
+}
+#endif
 
 uint64_t key_bytes_to_uint64(const uint8_t* key) {
     uint64_t result = 0;
@@ -7,6 +7,8 @@
 #pragma once
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
+#include "bambu_sha256.h"
 
 // Bambu Lab uses Mifare Classic 1K with 16 sectors
 #define BAMBU_NUM_SECTORS 16
@@ -17,8 +19,51 @@ typedef struct {
     uint8_t keys[BAMBU_NUM_SECTORS][BAMBU_KEY_LENGTH];
 } BambuKeys;
 
+// HKDF-Expand produces the 96 key bytes in three 32-byte blocks; sectors 0-4
+// lie entirely in the first block
+#define BAMBU_HASH_LEN 32
+#define BAMBU_EXPAND_BLOCKS 3
+
+// Longest ISO 14443-3A UID (triple size). Every UID buffer in the app is this
+// long, so a UID that fits one fits all of them.
+#define BAMBU_UID_MAX_LEN 10
+
+// Incremental key derivation for one UID. The PRK and each expand block are
+// computed the first time a key that needs them is requested, and kept for
+// later requests.
+typedef struct {
+    uint8_t uid[BAMBU_UID_MAX_LEN];
+    uint8_t uid_len;
+    uint8_t blocks;  // Expand blocks in okm so far, the PRK is valid once this is > 0
+    BambuHmacKey prk;  // PRK as keyed HMAC states, reused by every expand block
+    uint8_t okm[BAMBU_EXPAND_BLOCKS * BAMBU_HASH_LEN];
+} BambuKdf;
+
 // Calculate all 16 sector keys from tag UID
 void calculate_all_keys(const uint8_t* uid, size_t uid_len, BambuKeys* keys_out);
 
+// Master key as keyed HMAC states, for batch derivation backends
+const BambuHmacKey* bambu_master_hmac(void);
+
+// Start a derivation, nothing is computed yet
+void bambu_kdf_init(BambuKdf* kdf, const uint8_t* uid, size_t uid_len);
+
+// Key A of one sector, computing the expand blocks it needs
+const uint8_t* bambu_kdf_sector_key(BambuKdf* kdf, uint8_t sector);
+
+// Copy the keys of sectors 0..sector_count-1, plus any further sectors the
+// computed expand blocks already cover. Returns the number of keys copied.
+uint8_t bambu_kdf_get_keys(BambuKdf* kdf, uint8_t sector_count, BambuKeys* keys_out);
+
+#ifdef BAMBU_CRYPTO_REFERENCE
+// The same through mbedtls' generic HMAC, the reference for the self test.
+// Only tools/bambu_keygen and debug builds that define the guard compile it.
+void calculate_all_keys_mbedtls(const uint8_t* uid, size_t uid_len, BambuKeys* keys_out);
+
+// Check the precomputed states and the incremental derivation against
+// calculate_all_keys_mbedtls()
+bool bambu_crypto_self_test(void);
+#endif
+
 // Helper to get key as uint64_t for Flipper's MfClassic API
 uint64_t key_bytes_to_uint64(const uint8_t* key);
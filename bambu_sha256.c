@@ -0,0 +1,128 @@
+/**
+ * @file bambu_sha256.c
+ * @brief Allocation-free SHA-256 and HMAC-SHA256 for key derivation
+ * @author Tai Nguyen <taiducnguyen.drexel@gmail.com>
+ */
+
+#include "bambu_sha256.h"
+#include <string.h>
+
+static const uint32_t SHA256_IV[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+static const uint32_t SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define ROR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static uint32_t load_be32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void store_be32(uint8_t* p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+void bambu_sha256_compress(uint32_t state[8], const uint8_t block[BAMBU_SHA256_BLOCK_LEN]) {
+    // Rolling 16-word message schedule, keeps the stack footprint at 64 bytes
+    uint32_t w[16];
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+
+    for(int i = 0; i < 64; i++) {
+        uint32_t wi;
+        if(i < 16) {
+            wi = load_be32(&block[i * 4]);
+            w[i] = wi;
+        } else {
+            uint32_t w15 = w[(i - 15) & 15];
+            uint32_t w2 = w[(i - 2) & 15];
+            uint32_t s0 = ROR32(w15, 7) ^ ROR32(w15, 18) ^ (w15 >> 3);
+            uint32_t s1 = ROR32(w2, 17) ^ ROR32(w2, 19) ^ (w2 >> 10);
+            wi = w[i & 15] + s0 + w[(i - 7) & 15] + s1;
+            w[i & 15] = wi;
+        }
+
+        uint32_t t1 = h + (ROR32(e, 6) ^ ROR32(e, 11) ^ ROR32(e, 25)) + ((e & f) ^ (~e & g)) +
+                      SHA256_K[i] + wi;
+        uint32_t t2 = (ROR32(a, 2) ^ ROR32(a, 13) ^ ROR32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+void bambu_hmac_sha256_key(BambuHmacKey* hmac, const uint8_t* key, size_t key_len) {
+    uint8_t block[BAMBU_SHA256_BLOCK_LEN];
+
+    if(key_len > BAMBU_SHA256_BLOCK_LEN) key_len = BAMBU_SHA256_BLOCK_LEN;
+
+    memset(block, 0x36, sizeof(block));
+    for(size_t i = 0; i < key_len; i++) block[i] ^= key[i];
+    memcpy(hmac->inner, SHA256_IV, sizeof(SHA256_IV));
+    bambu_sha256_compress(hmac->inner, block);
+
+    memset(block, 0x5c, sizeof(block));
+    for(size_t i = 0; i < key_len; i++) block[i] ^= key[i];
+    memcpy(hmac->outer, SHA256_IV, sizeof(SHA256_IV));
+    bambu_sha256_compress(hmac->outer, block);
+}
+
+// Pad and compress the last block, which holds len bytes after the one pad block
+static void sha256_final_block(uint32_t state[8], uint8_t block[BAMBU_SHA256_BLOCK_LEN], size_t len) {
+    uint32_t bits = (uint32_t)(BAMBU_SHA256_BLOCK_LEN + len) * 8;
+
+    block[len] = 0x80;
+    memset(&block[len + 1], 0, BAMBU_SHA256_BLOCK_LEN - 4 - (len + 1));
+    store_be32(&block[BAMBU_SHA256_BLOCK_LEN - 4], bits);
+    bambu_sha256_compress(state, block);
+}
+
+void bambu_hmac_sha256_short(
+    const BambuHmacKey* hmac,
+    const uint8_t* msg,
+    size_t msg_len,
+    uint8_t out[BAMBU_SHA256_DIGEST_LEN]) {
+    uint8_t block[BAMBU_SHA256_BLOCK_LEN];
+    uint32_t state[8];
+
+    if(msg_len > BAMBU_HMAC_SHORT_MAX_LEN) msg_len = BAMBU_HMAC_SHORT_MAX_LEN;
+
+    // Inner hash: the ipad block is already in hmac->inner
+    memcpy(state, hmac->inner, sizeof(state));
+    memcpy(block, msg, msg_len);
+    sha256_final_block(state, block, msg_len);
+    for(int i = 0; i < 8; i++) store_be32(&block[i * 4], state[i]);
+
+    // Outer hash over the inner digest, which is already at the start of block
+    memcpy(state, hmac->outer, sizeof(state));
+    sha256_final_block(state, block, BAMBU_SHA256_DIGEST_LEN);
+    for(int i = 0; i < 8; i++) store_be32(&out[i * 4], state[i]);
+}
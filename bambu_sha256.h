@@ -0,0 +1,37 @@
+/**
+ * @file bambu_sha256.h
+ * @brief Allocation-free SHA-256 and HMAC-SHA256 for key derivation
+ * @author Tai Nguyen <taiducnguyen.drexel@gmail.com>
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#define BAMBU_SHA256_BLOCK_LEN 64
+#define BAMBU_SHA256_DIGEST_LEN 32
+
+// Longest message bambu_hmac_sha256_short() takes: the message, the 0x80
+// pad byte and the 8-byte length must fit in one block
+#define BAMBU_HMAC_SHORT_MAX_LEN (BAMBU_SHA256_BLOCK_LEN - 9)
+
+// HMAC key as the SHA-256 states after the ipad and opad blocks. Keying
+// costs two compressions; a keyed state can be reused for any number of
+// messages, and can be static data for a constant key.
+typedef struct {
+    uint32_t inner[8];
+    uint32_t outer[8];
+} BambuHmacKey;
+
+// One SHA-256 compression of a 64-byte block into state
+void bambu_sha256_compress(uint32_t state[8], const uint8_t block[BAMBU_SHA256_BLOCK_LEN]);
+
+// Compute the keyed states for a key of at most 64 bytes
+void bambu_hmac_sha256_key(BambuHmacKey* hmac, const uint8_t* key, size_t key_len);
+
+// HMAC of a message of at most BAMBU_HMAC_SHORT_MAX_LEN bytes, two compressions
+void bambu_hmac_sha256_short(
+    const BambuHmacKey* hmac,
+    const uint8_t* msg,
+    size_t msg_len,
+    uint8_t out[BAMBU_SHA256_DIGEST_LEN]);
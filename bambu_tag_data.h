@@ -7,6 +7,7 @@
 #pragma once
 #include <stdint.h>
 #include <stddef.h>
+#include "bambu_crypto.h"
 
 // ============================================
 // Bambu Lab Tag Block Layout
@@ -152,6 +153,23 @@ static const ColorPreset COLOR_PRESETS[] = {
 
 #define COLOR_PRESET_COUNT (sizeof(COLOR_PRESETS) / sizeof(COLOR_PRESETS[0]))
 
+// Preset closest to an RGB color, for naming colors read from tags
+static inline size_t color_preset_nearest(uint8_t r, uint8_t g, uint8_t b) {
+    size_t nearest = 0;
+    uint32_t nearest_distance = UINT32_MAX;
+    for(size_t i = 0; i < COLOR_PRESET_COUNT; i++) {
+        int32_t dr = r - COLOR_PRESETS[i].r;
+        int32_t dg = g - COLOR_PRESETS[i].g;
+        int32_t db = b - COLOR_PRESETS[i].b;
+        uint32_t distance = dr * dr + dg * dg + db * db;
+        if(distance < nearest_distance) {
+            nearest = i;
+            nearest_distance = distance;
+        }
+    }
+    return nearest;
+}
+
 // ============================================
 // Weight Presets (grams)
 // ============================================
@@ -218,7 +236,7 @@ typedef struct {
     uint16_t weight_grams;       // Spool weight in grams
 
     // Derived from UID after scanning
-    uint8_t uid[10];
+    uint8_t uid[BAMBU_UID_MAX_LEN];
     uint8_t uid_len;
 } TagProgramData;
 
@@ -277,3 +295,24 @@ static inline void prepare_block6(uint8_t* block, const ManufacturerPreset* manu
     if(len > 16) len = 16;
     memcpy(block, manufacturer->name, len);
 }
+
+// Extract a null-terminated string of at most max_len bytes from block data,
+// out holds max_len + 1
+static inline void extract_string(const uint8_t* data, size_t offset, size_t max_len, char* out) {
+    size_t i;
+    for(i = 0; i < max_len && data[offset + i] != 0; i++) {
+        out[i] = (char)data[offset + i];
+    }
+    out[i] = '\0';
+}
+
+// Prepare a sector trailer: Key A + writable access bits (FF 07 80) + user byte + Key B
+static inline void prepare_sector_trailer(uint8_t* block, const uint8_t* key) {
+    memset(block, 0, 16);
+    memcpy(block, key, 6);       // Key A
+    block[6] = 0xFF;             // Access bits
+    block[7] = 0x07;
+    block[8] = 0x80;
+    block[9] = 0x69;             // User byte
+    memcpy(&block[10], key, 6);  // Key B
+}
@@ -5,14 +5,21 @@
  */
 
 #include "bambu_tagger.h"
+#include "key_cache.h"
+#include "nfc_session.h"
 #include "scenes.h"
+#include "storage_worker.h"
 
 // ============================================
 // View Dispatcher callbacks
 // ============================================
 static bool app_navigation_callback(void* context) {
     App* app = context;
-    return scene_manager_handle_back_event(app->scene_manager);
+    if(scene_manager_handle_back_event(app->scene_manager)) return true;
+
+    // Back from the main menu stops the view dispatcher
+    storage_worker_stop_events(app->storage_worker);
+    return false;
 }
 
 static bool app_custom_event_callback(void* context, uint32_t event) {
@@ -20,11 +27,6 @@ static bool app_custom_event_callback(void* context, uint32_t event) {
     return scene_manager_handle_custom_event(app->scene_manager, event);
 }
 
-static void app_tick_event_callback(void* context) {
-    App* app = context;
-    scene_manager_handle_tick_event(app->scene_manager);
-}
-
 // ============================================
 // Application allocation/free
 // ============================================
@@ -64,6 +66,7 @@ static App* app_alloc(void) {
 
     // Allocate NFC
     app->nfc = nfc_alloc();
+    app->nfc_session = nfc_session_alloc(app);
 
     // Allocate MfClassic data structure for read/write operations
     app->mf_data = mf_classic_alloc();
@@ -71,6 +74,18 @@ static App* app_alloc(void) {
     // Allocate storage
     app->storage = furi_record_open(RECORD_STORAGE);
     app->saved_tag_path = furi_string_alloc();
+    app->result_text = furi_string_alloc();
+
+#ifdef BAMBU_CRYPTO_REFERENCE
+    furi_check(bambu_crypto_self_test());
+#endif
+
+    // Derived key cache, saved tags are derived once instead of on every scan.
+    // Recovery, loading and the warm-up run on the worker, which may rebuild
+    // the manifest; the NFC thread can use the cache meanwhile.
+    app->key_cache = key_cache_alloc();
+    app->storage_worker = storage_worker_alloc(app);
+    storage_worker_startup(app->storage_worker);
 
     // Initialize tag data defaults
     app->tag_data.filament_index = 0;
@@ -82,6 +97,9 @@ static App* app_alloc(void) {
 }
 
 static void app_free(App* app) {
+    // Finish queued saves first, their events are no longer posted
+    storage_worker_free(app->storage_worker);
+
     // Free views
     view_dispatcher_remove_view(app->view_dispatcher, ViewSubmenu);
     submenu_free(app->submenu);
@@ -105,10 +123,16 @@ static void app_free(App* app) {
     }
 
     // Free NFC
+    nfc_session_free(app->nfc_session);
     nfc_free(app->nfc);
 
+    // Save the key cache while storage is still open
+    key_cache_save(app->key_cache, app->storage);
+    key_cache_free(app->key_cache);
+
     // Free storage
     furi_string_free(app->saved_tag_path);
+    furi_string_free(app->result_text);
     furi_record_close(RECORD_STORAGE);
 
     // Close records
@@ -126,12 +150,6 @@ int32_t bambu_tagger_app(void* p) {
 
     App* app = app_alloc();
 
-    // Set tick event for polling (100ms interval)
-    view_dispatcher_set_tick_event_callback(
-        app->view_dispatcher,
-        app_tick_event_callback,
-        100);
-
     // Start with main menu
     scene_manager_next_scene(app->scene_manager, SceneMainMenu);
 
@@ -30,7 +30,11 @@
 #define TAG "BambuTagger"
 #define BAMBU_TAGGER_FOLDER EXT_PATH("apps_data/bambu_tagger")
 #define BAMBU_TAGGER_EXTENSION ".btag"
-#define MAX_SAVED_TAGS 32
+
+typedef struct NfcSession NfcSession;
+typedef struct KeyCache KeyCache;
+typedef struct TagManifestPage TagManifestPage;
+typedef struct StorageWorker StorageWorker;
 
 // ============================================
 // Scene definitions
@@ -49,6 +53,8 @@ typedef enum {
     SceneReadTagResult,
     SceneSavedTags,
     SceneSavedTagView,
+    SceneBatchWrite,
+    SceneInventory,
     SceneCount
 } AppScene;
 
@@ -65,27 +71,64 @@ typedef enum {
 // ============================================
 // Custom events
 // ============================================
+// NFC callbacks post the completion events (EventTagDetected ..
+// EventReadFailed) from the NFC thread; results are stored in App before
+// the event is sent. The storage worker posts EventTagSaved ..
+// EventTagsMigrated from its own thread; results with data are taken from
+// the worker.
 typedef enum {
     EventMainMenuProgram,
     EventMainMenuRead,
     EventMainMenuSaved,
+    EventMainMenuDump,
+    EventMainMenuInventory,
     EventFilamentSelected,
     EventManufacturerSelected,
     EventColorSelected,
     EventWeightSelected,
     EventConfirmed,
+    EventBatchStart,
     EventTagDetected,
+    EventTagTypeDetected,
     EventWriteSuccess,
     EventWriteFailed,
+    EventWriteInterrupted,
+    EventWriteWrongTag,
     EventReadSuccess,
     EventReadFailed,
+    EventReadDuplicate,
     EventSaveTag,
     EventSavedTagSelected,
     EventDeleteTag,
     EventProgramSavedTag,
+    EventMigrateTags,
+    EventSortTags,
+    EventSavedTagsNext,
+    EventSavedTagsPrevious,
+    EventTagSaved,
+    EventTagSaveFailed,
+    EventTagLoaded,
+    EventTagLoadFailed,
+    EventTagDeleted,
+    EventTagDeleteFailed,
+    EventSavedTagsPageLoaded,
+    EventTagsMigrated,
+    EventInventoryLogFailed,
     EventBack,
 } AppEvent;
 
+// ============================================
+// In-session retry for transient MIFARE errors
+// ============================================
+// Override with cdefines in application.fam. A retry re-authenticates the
+// sector and waits NFC_RETRY_BACKOFF_MS times the attempt number first.
+#ifndef NFC_RETRY_LIMIT
+#define NFC_RETRY_LIMIT 3
+#endif
+#ifndef NFC_RETRY_BACKOFF_MS
+#define NFC_RETRY_BACKOFF_MS 5
+#endif
+
 // ============================================
 // Tag type detection
 // ============================================
@@ -95,6 +138,79 @@ typedef enum {
     TagTypeBlank,
 } TagType;
 
+// ============================================
+// Per-block write status (every block of a 1K tag, so full dumps fit)
+// ============================================
+#define WRITE_BLOCK_COUNT 64
+
+typedef enum {
+    WriteBlockStatusPending,
+    WriteBlockStatusSkipped,   // Card already held the target data
+    WriteBlockStatusWritten,   // Written, read-back not done yet
+    WriteBlockStatusVerified,  // Written and read back identical
+    WriteBlockStatusMismatch,  // Written but read back different
+    WriteBlockStatusFailed,    // Auth, read or write error
+} WriteBlockStatus;
+
+// ============================================
+// Write journal (survives the tag slipping off mid-write)
+// ============================================
+// Records which blocks are verified on the card so tapping the same UID again
+// resumes at the first unfinished block. Sectors whose trailer is in
+// done_blocks already use the derived key, the rest still use the key the
+// write started with. That key is found per sector: a tag programmed by this
+// app has the derived key in sectors 0 and 1 and the default key in the rest.
+typedef struct {
+    bool active;           // A write to uid was started and is not finished
+    uint8_t uid[BAMBU_UID_MAX_LEN];
+    uint8_t uid_len;
+    uint16_t known_sectors;  // Bit N set = the key sector N started with is known
+    uint16_t blank_sectors;  // Bit N set = sector N started with the default FF key
+    uint32_t plan_hash;    // Hash of the target image, a new plan starts over
+    uint64_t done_blocks;  // Bit N set = block N is on the card
+} WriteJournal;
+
+// ============================================
+// Batch programming state
+// ============================================
+#define BATCH_MAX_UIDS 128
+
+typedef struct {
+    uint8_t uids[BATCH_MAX_UIDS][BAMBU_UID_MAX_LEN];  // Tags written in this batch, oldest overwritten
+    uint8_t uid_lens[BATCH_MAX_UIDS];
+    uint16_t uid_count;
+    uint16_t uid_next;
+    uint16_t written;
+    uint16_t failed;       // Failed tags given up on, a different tag was presented next
+    uint8_t failed_uid[BAMBU_UID_MAX_LEN];  // Last failed tag, it can still be resumed
+    uint8_t failed_uid_len;                 // 0 = none
+    uint16_t rejected;     // Original Bambu tags
+    uint32_t start_tick;   // Tick of the first tag presented, 0 = none yet
+} BatchState;
+
+// ============================================
+// Inventory read state
+// ============================================
+#define INVENTORY_UID_SLOTS 512         // Power of two
+#define INVENTORY_MAX_UIDS (INVENTORY_UID_SLOTS * 3 / 4)  // Sweep stops once this many are read
+#define INVENTORY_LOG_FLUSH_BYTES 1024  // Log buffer size before it is written out
+#define INVENTORY_LOG_PATH BAMBU_TAGGER_FOLDER "/inventory.csv"
+
+typedef struct {
+    uint8_t uid_len;  // 0 = empty slot
+    uint8_t uid[BAMBU_UID_MAX_LEN];
+} InventoryUid;
+
+typedef struct {
+    InventoryUid uids[INVENTORY_UID_SLOTS];  // Open addressing set of full UIDs
+    uint16_t count;
+    char last_type[17];     // Filament type of the last tag read
+    uint8_t last_rgb[3];
+    File* log_file;         // Append-only CSV log, opened by the storage worker
+    bool log_failed;        // The storage worker could not open log_file
+    FuriString* log_buffer; // Records not yet written to log_file
+} InventoryState;
+
 // ============================================
 // Read tag result data
 // ============================================
@@ -105,8 +221,40 @@ typedef struct {
     uint8_t block5[16];   // Color RGBA + Weight
     uint8_t block6[16];   // Manufacturer name
     bool valid;
+    bool has_dump;                 // Full 16-sector image is in App::mf_data
+    uint16_t dump_failed_sectors;  // Bit N set = sector N could not be authenticated
 } ReadTagData;
 
+// ============================================
+// Saved tag manifest entry (see tag_manifest.h)
+// ============================================
+// What the Saved Tags list shows of a tag, so it never opens the tag itself
+typedef struct {
+    char name[32];  // File name, or the UID name in tag database builds
+    uint8_t uid[BAMBU_UID_MAX_LEN];
+    uint8_t uid_len;
+    char material_id[9];    // Block 1
+    char type[17];          // Block 4, block 2 if that is empty
+    char manufacturer[17];  // Block 6
+    uint8_t rgba[4];
+    uint16_t weight;
+} TagManifestEntry;
+
+// Position of an entry in a sort order, ties are broken by manifest index
+typedef struct {
+    TagManifestEntry entry;
+    uint16_t index;
+} TagManifestCursor;
+
+typedef enum {
+    SavedTagsSortNone,  // Manifest order, pages are read directly
+    SavedTagsSortName,
+    SavedTagsSortType,
+    SavedTagsSortColor,
+    SavedTagsSortWeight,
+    SavedTagsSortCount,
+} SavedTagsSort;
+
 // ============================================
 // Application context
 // ============================================
@@ -123,39 +271,48 @@ typedef struct {
 
     // NFC components
     Nfc* nfc;
-    NfcScanner* scanner;
-    NfcPoller* poller;
+    NfcSession* nfc_session;  // Owns the scanner and pollers, see nfc_session.h
+    KeyCache* key_cache;      // Derived keys of recently seen UIDs, see key_cache.h
 
     // Tag programming data
     TagProgramData tag_data;
-    BambuKeys derived_keys;
+    BambuKeys derived_keys;  // Only the sectors the current operation needs, the rest are zero
 
     // Read tag data
     ReadTagData read_data;
 
-    // MfClassic data for read/write operations
+    // MfClassic data for read/write operations, holds the image in full dump mode
     MfClassicData* mf_data;
+    bool full_dump;             // Read scene dumps all 16 sectors instead of sectors 0-1
+    uint8_t dump_next_sector;   // Next sector handed to the poller in full dump mode
 
     // State flags
-    bool card_detected;
-    bool uid_read;
     bool write_success;
     bool write_in_progress;
+    WriteBlockStatus write_status[WRITE_BLOCK_COUNT];
+    WriteJournal write_journal;
+    uint16_t nfc_retries;  // Retries spent by the last detect/read/write session
+    BatchState batch;
+    InventoryState* inventory;  // While the Inventory scene is shown
+    FuriString* result_text;  // Backing text for the result popup
     bool read_success;
     bool read_in_progress;
 
     // Saved tags
     Storage* storage;
+    StorageWorker* storage_worker;  // Runs the scenes' SD card work off the GUI thread
     FuriString* saved_tag_path;  // Currently selected saved tag path
-    char saved_tags[MAX_SAVED_TAGS][64];  // List of saved tag filenames
-    uint8_t saved_tags_count;
+    TagManifestPage* saved_page;     // Visible page of the Saved Tags list, while it is shown
+    TagManifestCursor saved_cursor;  // First entry of that page, kept while a tag is viewed
+    bool saved_cursor_set;           // false = the list starts at the top
+    bool saved_tags_synced;          // Manifest checked against the saved tags this run
+    uint8_t saved_tags_sort;         // SavedTagsSort
     bool use_saved_tag;  // Flag to use loaded tag data for programming
     bool write_to_blank;  // Flag to use default key for blank tags
     TagType detected_tag_type;  // Result of tag type detection
-    bool detection_in_progress;  // Flag for detection phase
-
-    // Message queue for async events
-    FuriMessageQueue* event_queue;
+    bool write_detect;  // Write session detects the tag type first (not a resume)
+    bool batch_active;  // Batch scene is running, written UIDs are skipped
+    bool inventory_active;  // Inventory scene is running, seen UIDs are not read again
 } App;
 
 // Scene handler declarations (defined in scenes.c)
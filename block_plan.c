@@ -0,0 +1,201 @@
+/**
+ * @file block_plan.c
+ * @brief Declarative block plans for reading and writing tags
+ * @author Tai Nguyen <taiducnguyen.drexel@gmail.com>
+ */
+
+#include "block_plan.h"
+
+// ============================================
+// Plan tables
+// ============================================
+// Filament data of sectors 0 and 1. Block 6 (manufacturer) is missing on
+// some tags, those read as "Generic".
+static const PlanEntry read_filament_table[] = {
+    {1, PlanSourceCard, PlanKeyDerived, 0},
+    {2, PlanSourceCard, PlanKeyDerived, 0},
+    {4, PlanSourceCard, PlanKeyDerived, 0},
+    {5, PlanSourceCard, PlanKeyDerived, 0},
+    {6, PlanSourceCard, PlanKeyDerived, PLAN_FLAG_OPTIONAL},
+};
+
+// Sectors 0 and 1 of a programmed tag, the data source is swapped for saved tags
+static const PlanEntry write_filament_table[] = {
+    {1, PlanSourceTemplate, PlanKeyCurrent, 0},
+    {2, PlanSourceTemplate, PlanKeyCurrent, 0},
+    {3, PlanSourceTrailer, PlanKeyCurrent, 0},
+    {4, PlanSourceTemplate, PlanKeyCurrent, 0},
+    {5, PlanSourceTemplate, PlanKeyCurrent, 0},
+    {6, PlanSourceTemplate, PlanKeyCurrent, 0},
+    {7, PlanSourceTrailer, PlanKeyCurrent, 0},
+};
+
+// ============================================
+// Plan building
+// ============================================
+void block_plan_reset(BlockPlan* plan) {
+    plan->count = 0;
+    plan->auth_count = 0;
+}
+
+void block_plan_add(BlockPlan* plan, uint8_t block, PlanSource source, PlanKey key, uint8_t flags) {
+    furi_check(block < WRITE_BLOCK_COUNT);
+
+    PlanEntry* entry = NULL;
+    for(uint8_t i = 0; i < plan->count; i++) {
+        if(plan->entries[i].block == block) {
+            entry = &plan->entries[i];
+            break;
+        }
+    }
+    if(entry == NULL) {
+        entry = &plan->entries[plan->count++];
+    }
+
+    entry->block = block;
+    entry->source = source;
+    entry->key = key;
+    entry->flags = flags;
+}
+
+void block_plan_add_table(BlockPlan* plan, const PlanEntry* table, size_t count) {
+    for(size_t i = 0; i < count; i++) {
+        block_plan_add(plan, table[i].block, table[i].source, table[i].key, table[i].flags);
+    }
+}
+
+void block_plan_compile(BlockPlan* plan) {
+    // Insertion sort, plans have at most 64 entries and are mostly in order
+    for(uint8_t i = 1; i < plan->count; i++) {
+        PlanEntry entry = plan->entries[i];
+        uint8_t j = i;
+        while(j > 0 && plan->entries[j - 1].block > entry.block) {
+            plan->entries[j] = plan->entries[j - 1];
+            j--;
+        }
+        plan->entries[j] = entry;
+    }
+
+    plan->auth_count = 0;
+    for(uint8_t i = 0; i < plan->count; i++) {
+        if(i == 0 || plan->entries[i].block / 4 != plan->entries[i - 1].block / 4) {
+            plan->auth_count++;
+        }
+    }
+}
+
+uint8_t block_plan_sector_count(const BlockPlan* plan) {
+    if(plan->count == 0) return 0;
+    return plan->entries[plan->count - 1].block / 4 + 1;
+}
+
+void block_plan_build_read(BlockPlan* plan) {
+    block_plan_reset(plan);
+    block_plan_add_table(plan, read_filament_table, COUNT_OF(read_filament_table));
+    block_plan_compile(plan);
+}
+
+void block_plan_build_write(const App* app, BlockPlan* plan) {
+    block_plan_reset(plan);
+    block_plan_add_table(plan, write_filament_table, COUNT_OF(write_filament_table));
+
+    if(app->use_saved_tag) {
+        for(uint8_t i = 0; i < plan->count; i++) {
+            if(plan->entries[i].source == PlanSourceTemplate) {
+                plan->entries[i].source = PlanSourceSaved;
+            }
+        }
+    }
+
+    // A loaded full dump also clones sectors 2-15, except sectors that
+    // could not be read and have nothing to clone
+    if(app->use_saved_tag && app->read_data.has_dump) {
+        for(uint8_t block = 8; block < WRITE_BLOCK_COUNT; block++) {
+            if(app->read_data.dump_failed_sectors & (1 << (block / 4))) continue;
+            block_plan_add(
+                plan,
+                block,
+                (block % 4 == 3) ? PlanSourceTrailer : PlanSourceDump,
+                PlanKeyCurrent,
+                0);
+        }
+    }
+
+    block_plan_compile(plan);
+}
+
+// ============================================
+// Write data
+// ============================================
+// ReadTagData field holding a block, NULL for blocks it doesn't keep
+static const uint8_t* saved_block_data(const ReadTagData* data, uint8_t block) {
+    switch(block) {
+    case 1:
+        return data->block1;
+    case 2:
+        return data->block2;
+    case 4:
+        return data->block4;
+    case 5:
+        return data->block5;
+    case 6:
+        return data->block6;
+    default:
+        return NULL;
+    }
+}
+
+// Filament data blocks built from the presets selected in the UI
+static void template_block_data(const App* app, uint8_t block, uint8_t* data) {
+    const FilamentInfo* filament = &BAMBU_FILAMENTS[app->tag_data.filament_index];
+
+    switch(block) {
+    case 1:
+        prepare_block1(data, filament);
+        break;
+    case 2:
+        prepare_block2(data, filament);
+        break;
+    case 4:
+        prepare_block4(data, filament);
+        break;
+    case 5:
+        prepare_block5(
+            data, &COLOR_PRESETS[app->tag_data.color_index], app->tag_data.weight_grams);
+        break;
+    case 6:
+        prepare_block6(data, &MANUFACTURER_PRESETS[app->tag_data.manufacturer_index]);
+        break;
+    default:
+        memset(data, 0, 16);
+        break;
+    }
+}
+
+void block_plan_prepare(const App* app, const PlanEntry* entry, MfClassicBlock* block_data) {
+    const uint8_t* saved;
+
+    switch(entry->source) {
+    case PlanSourceTemplate:
+        template_block_data(app, entry->block, block_data->data);
+        break;
+    case PlanSourceSaved:
+        saved = saved_block_data(&app->read_data, entry->block);
+        if(saved) {
+            memcpy(block_data->data, saved, 16);
+        } else {
+            memset(block_data->data, 0, 16);
+        }
+        break;
+    case PlanSourceDump:
+        memcpy(block_data->data, app->mf_data->block[entry->block].data, 16);
+        break;
+    case PlanSourceTrailer:
+        prepare_sector_trailer(block_data->data, app->derived_keys.keys[entry->block / 4]);
+        break;
+    default:
+        // PlanSourceCard has nothing to write
+        memset(block_data->data, 0, 16);
+        break;
+    }
+}
@@ -0,0 +1,69 @@
+/**
+ * @file block_plan.h
+ * @brief Declarative block plans for reading and writing tags
+ * @author Tai Nguyen <taiducnguyen.drexel@gmail.com>
+ */
+
+#pragma once
+
+#include "bambu_tagger.h"
+
+// ============================================
+// Plan entries
+// ============================================
+// Where the data of a plan entry comes from (or goes to, for reads)
+typedef enum {
+    PlanSourceCard,      // Read from the card into App::mf_data
+    PlanSourceTemplate,  // Filament/color/manufacturer presets in TagProgramData
+    PlanSourceSaved,     // Blocks of a loaded tag in ReadTagData
+    PlanSourceDump,      // Full dump image in App::mf_data
+    PlanSourceTrailer,   // Sector trailer with the derived keys and writable access bits
+} PlanSource;
+
+// Key A used to authenticate the entry's sector
+typedef enum {
+    PlanKeyDerived,  // Bambu key derived from the UID
+    PlanKeyCurrent,  // Key the sector has right now, tracked by the write journal
+} PlanKey;
+
+#define PLAN_FLAG_OPTIONAL (1 << 0)  // A failure of this entry does not fail the plan
+
+typedef struct {
+    uint8_t block;
+    uint8_t source;  // PlanSource
+    uint8_t key;     // PlanKey
+    uint8_t flags;
+} PlanEntry;
+
+// Entries sorted by block once compiled, so the runner authenticates each
+// sector exactly once, in order
+typedef struct {
+    PlanEntry entries[WRITE_BLOCK_COUNT];
+    uint8_t count;
+    uint8_t auth_count;  // Sector authentications the plan needs
+} BlockPlan;
+
+// Empty the plan
+void block_plan_reset(BlockPlan* plan);
+
+// Add an entry, replacing an earlier entry for the same block
+void block_plan_add(BlockPlan* plan, uint8_t block, PlanSource source, PlanKey key, uint8_t flags);
+
+// Add a table of entries
+void block_plan_add_table(BlockPlan* plan, const PlanEntry* table, size_t count);
+
+// Sort by block and count the sector authentications
+void block_plan_compile(BlockPlan* plan);
+
+// Sectors 0..N-1 cover every block of a compiled plan, the derived keys it needs
+uint8_t block_plan_sector_count(const BlockPlan* plan);
+
+// Plan for reading the filament blocks of sectors 0 and 1
+void block_plan_build_read(BlockPlan* plan);
+
+// Plan for the current write: template or saved tag, plus every readable
+// sector of a loaded full dump
+void block_plan_build_write(const App* app, BlockPlan* plan);
+
+// Fill the data a write entry puts on the card
+void block_plan_prepare(const App* app, const PlanEntry* entry, MfClassicBlock* block_data);
@@ -0,0 +1,167 @@
+/**
+ * @file btag_format.c
+ * @brief Binary .btag v2 record format
+ * @author Tai Nguyen <taiducnguyen.drexel@gmail.com>
+ */
+
+#include "btag_format.h"
+
+// Nibble table, 64 bytes instead of the usual 1 KB
+static const uint32_t crc32_nibble[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+};
+
+uint32_t btag_crc32(uint32_t crc, const void* data, size_t size) {
+    const uint8_t* bytes = data;
+
+    crc = ~crc;
+    for(size_t i = 0; i < size; i++) {
+        crc ^= bytes[i];
+        crc = (crc >> 4) ^ crc32_nibble[crc & 0x0F];
+        crc = (crc >> 4) ^ crc32_nibble[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+static uint8_t block_count(uint64_t mask) {
+    uint8_t count = 0;
+    for(; mask; mask &= mask - 1) count++;
+    return count;
+}
+
+size_t btag_record_size(const BtagHeader* header) {
+    return sizeof(BtagHeader) + block_count(header->block_mask) * 16 + sizeof(uint32_t);
+}
+
+size_t btag_record_seal(BtagRecord* record) {
+    size_t crc_offset = btag_record_size(&record->header) - sizeof(uint32_t);
+    uint32_t crc = btag_crc32(0, record, crc_offset);
+    memcpy((uint8_t*)record + crc_offset, &crc, sizeof(crc));
+    return crc_offset + sizeof(crc);
+}
+
+const uint8_t* btag_record_block(const BtagRecord* record, uint8_t block) {
+    uint64_t bit = 1ull << block;
+    if(block >= WRITE_BLOCK_COUNT || !(record->header.block_mask & bit)) return NULL;
+    return record->blocks[block_count(record->header.block_mask & (bit - 1))];
+}
+
+void btag_record_set_block(BtagRecord* record, uint8_t block, const uint8_t* data) {
+    BtagHeader* header = &record->header;
+    uint64_t bit = 1ull << block;
+    uint8_t position = block_count(header->block_mask & (bit - 1));
+
+    if(!(header->block_mask & bit)) {
+        uint8_t count = block_count(header->block_mask);
+        memmove(record->blocks[position + 1], record->blocks[position], (count - position) * 16);
+        header->block_mask |= bit;
+    }
+    memcpy(record->blocks[position], data, 16);
+}
+
+// ReadTagData field holding a filament block, NULL for other blocks
+static uint8_t* filament_block(ReadTagData* data, uint8_t block) {
+    switch(block) {
+    case 1:
+        return data->block1;
+    case 2:
+        return data->block2;
+    case 4:
+        return data->block4;
+    case 5:
+        return data->block5;
+    case 6:
+        return data->block6;
+    default:
+        return NULL;
+    }
+}
+
+size_t btag_record_from_app(const App* app, BtagRecord* record) {
+    BtagHeader* header = &record->header;
+    const ReadTagData* data = &app->read_data;
+    uint8_t count = 0;
+
+    memset(header, 0, sizeof(BtagHeader));
+    header->magic = BTAG_MAGIC;
+    header->version = BTAG_VERSION;
+    header->uid_len = MIN(app->tag_data.uid_len, sizeof(header->uid));
+    memcpy(header->uid, app->tag_data.uid, header->uid_len);
+
+    if(data->has_dump) {
+        // Every block that was read; read_data mirrors blocks 1-6 of the image
+        header->flags |= BTAG_FLAG_DUMP;
+        header->failed_sectors = data->dump_failed_sectors;
+        for(uint8_t block = 0; block < WRITE_BLOCK_COUNT; block++) {
+            if(!mf_classic_is_block_read(app->mf_data, block)) continue;
+            header->block_mask |= 1ull << block;
+            memcpy(record->blocks[count++], app->mf_data->block[block].data, 16);
+        }
+    } else {
+        const uint8_t* filament[] = {
+            [1] = data->block1, [2] = data->block2, [4] = data->block4, [5] = data->block5,
+            [6] = data->block6};
+        header->block_mask = BTAG_FILAMENT_BLOCK_MASK;
+        for(uint8_t block = 0; block < COUNT_OF(filament); block++) {
+            if(filament[block]) memcpy(record->blocks[count++], filament[block], 16);
+        }
+    }
+
+    return btag_record_seal(record);
+}
+
+bool btag_record_check(const BtagRecord* record, size_t size) {
+    const BtagHeader* header = &record->header;
+
+    if(size < sizeof(BtagHeader) + sizeof(uint32_t)) return false;
+    if(header->magic != BTAG_MAGIC || header->version != BTAG_VERSION) return false;
+    if(header->uid_len == 0 || header->uid_len > sizeof(header->uid)) return false;
+    if(btag_record_size(header) != size) return false;
+
+    size_t crc_offset = size - sizeof(uint32_t);
+    uint32_t crc;
+    memcpy(&crc, (const uint8_t*)record + crc_offset, sizeof(crc));
+    return crc == btag_crc32(0, record, crc_offset);
+}
+
+void btag_record_to_app(const BtagRecord* record, App* app) {
+    const BtagHeader* header = &record->header;
+    ReadTagData* data = &app->read_data;
+    bool dump = header->flags & BTAG_FLAG_DUMP;
+    uint8_t count = 0;
+
+    memset(app->tag_data.uid, 0, sizeof(app->tag_data.uid));
+    memcpy(app->tag_data.uid, header->uid, header->uid_len);
+    app->tag_data.uid_len = header->uid_len;
+
+    // Blocks missing from the record read as zeros, block 6 then shows "Generic"
+    memset(data->block1, 0, 16);
+    memset(data->block2, 0, 16);
+    memset(data->block4, 0, 16);
+    memset(data->block5, 0, 16);
+    memset(data->block6, 0, 16);
+
+    if(dump) {
+        mf_classic_reset(app->mf_data);
+        app->mf_data->type = MfClassicType1k;
+        mf_classic_set_uid(app->mf_data, header->uid, header->uid_len);
+    }
+
+    for(uint8_t block = 0; block < WRITE_BLOCK_COUNT; block++) {
+        if(!(header->block_mask & (1ull << block))) continue;
+        const uint8_t* block_data = record->blocks[count++];
+
+        uint8_t* field = filament_block(data, block);
+        if(field) memcpy(field, block_data, 16);
+        if(dump) {
+            MfClassicBlock mf_block;
+            memcpy(mf_block.data, block_data, 16);
+            mf_classic_set_block_read(app->mf_data, block, &mf_block);
+        }
+    }
+
+    data->has_dump = dump;
+    data->dump_failed_sectors = dump ? header->failed_sectors : 0;
+    data->valid = true;
+}
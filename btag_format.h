@@ -0,0 +1,68 @@
+/**
+ * @file btag_format.h
+ * @brief Binary .btag v2 record format
+ * @author Tai Nguyen <taiducnguyen.drexel@gmail.com>
+ */
+
+#pragma once
+
+#include "bambu_tagger.h"
+
+// ============================================
+// Record layout
+// ============================================
+// A v2 file is the header, 16 bytes for each block set in block_mask in
+// block order, then a CRC32 of everything before it. v1 files are text and
+// start with "Filetype:", so the magic tells the two apart.
+#define BTAG_MAGIC 0x47415442u  // "BTAG"
+#define BTAG_VERSION 2
+
+#define BTAG_FLAG_DUMP (1 << 0)     // Full dump, failed_sectors is valid
+#define BTAG_FLAG_DELETED (1 << 1)  // Tag database tombstone, no blocks
+
+// Blocks 1, 2, 4, 5 and 6 of a filament record
+#define BTAG_FILAMENT_BLOCK_MASK 0x76ull
+
+typedef struct {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t flags;
+    uint16_t failed_sectors;  // Bit N set = sector N could not be authenticated
+    uint64_t block_mask;      // Bit N set = block N is in the record
+    uint8_t uid_len;
+    uint8_t uid[BAMBU_UID_MAX_LEN];
+    uint8_t reserved[5];
+} BtagHeader;
+
+// Largest record, the file is read into it in one go. The CRC follows the
+// last block present, so it lands inside blocks[] for short records.
+typedef struct {
+    BtagHeader header;
+    uint8_t blocks[WRITE_BLOCK_COUNT][16];
+    uint32_t crc_max;  // CRC slot when all 64 blocks are present
+} BtagRecord;
+
+// Bytes a record with this header takes on SD, CRC included
+size_t btag_record_size(const BtagHeader* header);
+
+// CRC-32 (IEEE 802.3), continuing from crc (0 to start)
+uint32_t btag_crc32(uint32_t crc, const void* data, size_t size);
+
+// Write the CRC after the blocks in block_mask, returns the record size
+size_t btag_record_seal(BtagRecord* record);
+
+// The 16 bytes of a block in the record, NULL if it is not present
+const uint8_t* btag_record_block(const BtagRecord* record, uint8_t block);
+
+// Add or replace a block, keeping the blocks in block order
+void btag_record_set_block(BtagRecord* record, uint8_t block, const uint8_t* data);
+
+// Build the record for the tag in tag_data/read_data (and mf_data for dumps),
+// returns the bytes to write
+size_t btag_record_from_app(const App* app, BtagRecord* record);
+
+// Check magic, version, size and CRC of a record read from SD
+bool btag_record_check(const BtagRecord* record, size_t size);
+
+// Load a checked record into tag_data/read_data (and mf_data for dumps)
+void btag_record_to_app(const BtagRecord* record, App* app);
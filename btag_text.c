@@ -0,0 +1,158 @@
+/**
+ * @file btag_text.c
+ * @brief Streaming parser for v1 text .btag files
+ * @author Tai Nguyen <taiducnguyen.drexel@gmail.com>
+ */
+
+#include "btag_text.h"
+
+#include <string.h>
+
+#define BLOCK_SIZE 16
+
+static int hex_digit(char c) {
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+static const char* skip_spaces(const char* text) {
+    while(*text == ' ' || *text == '\t') text++;
+    return text;
+}
+
+// Space separated two-digit hex bytes, returns how many or -1 if malformed.
+// "??" is only taken where unread is given, and sets it.
+static int parse_hex_bytes(const char* text, uint8_t* out, uint8_t max, bool* unread) {
+    int count = 0;
+
+    for(text = skip_spaces(text); *text; text = skip_spaces(text)) {
+        if(count == max) return -1;
+        if(text[0] == '?' && text[1] == '?' && unread) {
+            out[count] = 0;
+            *unread = true;
+        } else {
+            int high = hex_digit(text[0]);
+            int low = high < 0 ? -1 : hex_digit(text[1]);
+            if(low < 0) return -1;
+            out[count] = (high << 4) | low;
+        }
+        text += 2;
+        if(*text && *text != ' ' && *text != '\t') return -1;
+        count++;
+    }
+    return count;
+}
+
+// Unsigned number in base 10 or 16 with up to max_digits digits, nothing after it
+static bool parse_number(const char* text, int base, uint8_t max_digits, uint32_t* out) {
+    uint8_t digits = 0;
+
+    *out = 0;
+    for(text = skip_spaces(text); *text; text++, digits++) {
+        int digit = hex_digit(*text);
+        if(digit < 0 || digit >= base || digits == max_digits) return false;
+        *out = *out * base + digit;
+    }
+    return digits > 0;
+}
+
+// "Block_N" with N from 0 to 255, -1 for any other key
+static int block_key(const char* key) {
+    uint32_t block;
+    if(strncmp(key, "Block_", 6) != 0 || !parse_number(key + 6, 10, 3, &block) || block > 255) {
+        return -1;
+    }
+    return block;
+}
+
+static bool known_key(const char* key) {
+    return strcmp(key, "UID") == 0 || strcmp(key, "UID_len") == 0 ||
+           strcmp(key, "Sectors_failed") == 0 || block_key(key) >= 0;
+}
+
+// Handle one complete line, false if it is malformed
+static bool parse_line(BtagTextParser* parser) {
+    char* text = parser->text;
+    size_t length = parser->length;
+
+    // A NUL means this is not a text file
+    if(strlen(text) != length) return false;
+    while(length > 0 && (text[length - 1] == '\r' || text[length - 1] == ' ' ||
+                         text[length - 1] == '\t')) {
+        text[--length] = '\0';
+    }
+
+    text = (char*)skip_spaces(text);
+    char* value = strchr(text, ':');
+    if(*text == '\0' || *text == '#' || !value) return true;
+    *value++ = '\0';
+
+    // Only the start of an overlong line is kept, its value is lost
+    if(parser->overflow) return !known_key(text);
+
+    uint32_t number;
+    int block = block_key(text);
+    if(block >= 0) {
+        uint8_t data[BLOCK_SIZE];
+        bool unread = false;
+        if(parse_hex_bytes(value, data, BLOCK_SIZE, &unread) != BLOCK_SIZE) return false;
+        if(!unread) parser->callback(block, data, parser->context);
+    } else if(strcmp(text, "UID") == 0) {
+        int count = parse_hex_bytes(value, parser->uid, BTAG_TEXT_UID_MAX, NULL);
+        if(count <= 0) return false;
+        parser->uid_bytes = count;
+    } else if(strcmp(text, "UID_len") == 0) {
+        if(!parse_number(value, 10, 2, &number) || number == 0 || number > BTAG_TEXT_UID_MAX) {
+            return false;
+        }
+        parser->uid_len = number;
+        parser->has_uid_len = true;
+    } else if(strcmp(text, "Sectors_failed") == 0) {
+        if(!parse_number(value, 16, 4, &number)) return false;
+        parser->failed_sectors = number;
+        parser->has_dump = true;
+    }
+    return true;
+}
+
+static void end_line(BtagTextParser* parser) {
+    parser->text[parser->length] = '\0';
+    parser->line++;
+    if(!parse_line(parser)) parser->failed = true;
+    parser->length = 0;
+    parser->overflow = false;
+}
+
+void btag_text_init(BtagTextParser* parser, BtagTextBlockCallback callback, void* context) {
+    memset(parser, 0, sizeof(BtagTextParser));
+    parser->callback = callback;
+    parser->context = context;
+}
+
+bool btag_text_feed(BtagTextParser* parser, const char* data, size_t size) {
+    while(size > 0 && !parser->failed) {
+        const char* newline = memchr(data, '\n', size);
+        size_t part = newline ? (size_t)(newline - data) : size;
+
+        // Copy what fits, the rest of an overlong line is dropped
+        size_t room = BTAG_TEXT_LINE_MAX - parser->length;
+        if(part > room) parser->overflow = true;
+        memcpy(parser->text + parser->length, data, part < room ? part : room);
+        parser->length += part < room ? part : room;
+
+        if(!newline) break;
+        end_line(parser);
+        data += part + 1;
+        size -= part + 1;
+    }
+    return !parser->failed;
+}
+
+bool btag_text_finish(BtagTextParser* parser) {
+    if(!parser->failed && (parser->length > 0 || parser->overflow)) end_line(parser);
+    if(parser->failed || parser->uid_bytes == 0) return false;
+    if(!parser->has_uid_len) parser->uid_len = parser->uid_bytes;
+    return true;
+}
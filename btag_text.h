@@ -0,0 +1,59 @@
+/**
+ * @file btag_text.h
+ * @brief Streaming parser for v1 text .btag files
+ * @author Tai Nguyen <taiducnguyen.drexel@gmail.com>
+ */
+
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// ============================================
+// v1 text format
+// ============================================
+// "Key: value" lines. The keys read are UID (hex bytes), UID_len (decimal),
+// Sectors_failed (hex, present in full dumps) and Block_N (16 hex bytes,
+// "??" for a byte that was not read). Other keys, blank lines and "#"
+// comments are skipped. A known key with a malformed value fails the whole
+// file, so nothing from an earlier tag is left in place of the bad bytes.
+//
+// The file is fed in chunks of any size and each line is handled as soon as
+// it ends. Only the line being read is kept, the file is never buffered.
+
+// Longest line kept, long enough for "Block_255:" and 16 bytes. A longer
+// line is skipped if its key is unknown and fails the file otherwise.
+#define BTAG_TEXT_LINE_MAX 80
+
+#define BTAG_TEXT_UID_MAX 10
+
+// Called for each block line as it is parsed. Blocks with a "??" byte are
+// not reported. A block can be reported twice if the file repeats it.
+typedef void (*BtagTextBlockCallback)(uint8_t block, const uint8_t* data, void* context);
+
+typedef struct {
+    // Parsed so far
+    uint8_t uid[BTAG_TEXT_UID_MAX];
+    uint8_t uid_bytes;  // UID bytes on the UID line
+    uint8_t uid_len;    // UID_len, the UID line's byte count if absent
+    bool has_uid_len;
+    bool has_dump;  // Sectors_failed was present
+    uint16_t failed_sectors;
+    uint16_t line;  // Lines ended so far, the failing line once failed is set
+    bool failed;
+
+    // Line being read
+    BtagTextBlockCallback callback;
+    void* context;
+    char text[BTAG_TEXT_LINE_MAX + 1];
+    uint8_t length;
+    bool overflow;
+} BtagTextParser;
+
+void btag_text_init(BtagTextParser* parser, BtagTextBlockCallback callback, void* context);
+
+// Parse the next chunk of the file, false once the file has failed
+bool btag_text_feed(BtagTextParser* parser, const char* data, size_t size);
+
+// Parse a last line without a newline, true if the file is a complete tag
+bool btag_text_finish(BtagTextParser* parser);
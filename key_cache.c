@@ -0,0 +1,226 @@
+/**
+ * @file key_cache.c
+ * @brief UID-keyed cache of derived sector keys, kept in RAM and on SD
+ * @author Tai Nguyen <taiducnguyen.drexel@gmail.com>
+ */
+
+#include "key_cache.h"
+#include "tag_storage.h"
+#include "tag_manifest.h"
+
+#define KEY_CACHE_MAGIC 0x31434B42u  // "BKC1"
+#define KEY_CACHE_VERSION 3
+
+#define KEY_CACHE_WARM_CHUNK 4  // Manifest entries read at a time when warming
+
+// The file stores the entries as they are in RAM, most recently used first
+typedef struct {
+    uint8_t uid[BAMBU_UID_MAX_LEN];
+    uint8_t uid_len;
+    uint8_t key_count;  // Keys of sectors 0..key_count-1 are derived
+    BambuKeys keys;
+} KeyCacheEntry;
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t count;
+    uint32_t hash;  // FNV-1a over the entries
+} KeyCacheHeader;
+
+struct KeyCache {
+    FuriMutex* mutex;  // The NFC thread looks up keys while the storage worker loads and warms
+    KeyCacheEntry entries[KEY_CACHE_SIZE];  // Most recently used first
+    uint16_t count;
+    bool dirty;
+
+    // Logged on free
+    uint32_t hits;
+    uint32_t misses;
+};
+
+KeyCache* key_cache_alloc(void) {
+    KeyCache* cache = malloc(sizeof(KeyCache));
+    memset(cache, 0, sizeof(KeyCache));
+    cache->mutex = furi_mutex_alloc(FuriMutexTypeNormal);
+    return cache;
+}
+
+void key_cache_free(KeyCache* cache) {
+    FURI_LOG_I(
+        TAG,
+        "Key cache: %u entries, %lu hits, %lu misses",
+        cache->count,
+        (unsigned long)cache->hits,
+        (unsigned long)cache->misses);
+    furi_mutex_free(cache->mutex);
+    free(cache);
+}
+
+static uint32_t key_cache_hash(const KeyCacheEntry* entries, uint16_t count) {
+    const uint8_t* bytes = (const uint8_t*)entries;
+    uint32_t hash = 2166136261u;
+
+    for(size_t i = 0; i < count * sizeof(KeyCacheEntry); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+bool key_cache_load(KeyCache* cache, Storage* storage) {
+    File* file = storage_file_alloc(storage);
+    bool success = false;
+    KeyCacheHeader header;
+
+    furi_mutex_acquire(cache->mutex, FuriWaitForever);
+    cache->count = 0;
+    if(storage_file_open(file, KEY_CACHE_PATH, FSAM_READ, FSOM_OPEN_EXISTING) &&
+       storage_file_read(file, &header, sizeof(header)) == sizeof(header) &&
+       header.magic == KEY_CACHE_MAGIC && header.version == KEY_CACHE_VERSION) {
+        // A cache saved by a build with a bigger KEY_CACHE_SIZE is dropped
+        size_t size = header.count * sizeof(KeyCacheEntry);
+
+        if(header.count <= KEY_CACHE_SIZE &&
+           storage_file_read(file, cache->entries, size) == size &&
+           key_cache_hash(cache->entries, header.count) == header.hash) {
+            cache->count = header.count;
+            success = true;
+        }
+    }
+
+    storage_file_close(file);
+    storage_file_free(file);
+
+    cache->dirty = false;
+    if(success) {
+        FURI_LOG_I(TAG, "Key cache: loaded %u entries", cache->count);
+    }
+    furi_mutex_release(cache->mutex);
+    return success;
+}
+
+bool key_cache_save(KeyCache* cache, Storage* storage) {
+    if(!cache->dirty) return true;
+    if(!ensure_storage_dir(storage)) return false;
+
+    KeyCacheHeader header = {
+        .magic = KEY_CACHE_MAGIC,
+        .version = KEY_CACHE_VERSION,
+        .count = cache->count,
+        .hash = key_cache_hash(cache->entries, cache->count),
+    };
+    size_t size = cache->count * sizeof(KeyCacheEntry);
+
+    File* file = storage_file_alloc(storage);
+    bool success = false;
+    if(storage_file_open(file, KEY_CACHE_PATH, FSAM_WRITE, FSOM_CREATE_ALWAYS)) {
+        success = storage_file_write(file, &header, sizeof(header)) == sizeof(header) &&
+                  storage_file_write(file, cache->entries, size) == size;
+    }
+    storage_file_close(file);
+    storage_file_free(file);
+
+    if(success) {
+        cache->dirty = false;
+    } else {
+        FURI_LOG_E(TAG, "Failed to write %s", KEY_CACHE_PATH);
+    }
+    return success;
+}
+
+static int32_t key_cache_find(const KeyCache* cache, const uint8_t* uid, uint8_t uid_len) {
+    for(uint16_t i = 0; i < cache->count; i++) {
+        const KeyCacheEntry* entry = &cache->entries[i];
+        if(entry->uid_len == uid_len && memcmp(entry->uid, uid, uid_len) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void key_cache_warm(KeyCache* cache, App* app) {
+    uint16_t added = 0;
+
+    // The UIDs come from the manifest, brought up to date first
+    sync_saved_tags(app);
+    TagManifestEntry manifest[KEY_CACHE_WARM_CHUNK];
+    uint16_t read;
+    for(uint16_t first = 0; cache->count < KEY_CACHE_SIZE; first += read) {
+        read = tag_manifest_read(app->storage, first, manifest, KEY_CACHE_WARM_CHUNK);
+        if(read == 0) break;
+
+        // Held per chunk, the manifest is read with the cache free for scans
+        furi_mutex_acquire(cache->mutex, FuriWaitForever);
+        for(uint16_t i = 0; i < read && cache->count < KEY_CACHE_SIZE; i++) {
+            const uint8_t* uid = manifest[i].uid;
+            uint8_t uid_len = manifest[i].uid_len;
+            // Tags that failed to load are listed without a UID
+            if(uid_len == 0 || key_cache_find(cache, uid, uid_len) >= 0) continue;
+
+            // Appended as least recently used, warming never evicts scanned tags
+            KeyCacheEntry* entry = &cache->entries[cache->count++];
+            memset(entry, 0, sizeof(KeyCacheEntry));
+            memcpy(entry->uid, uid, uid_len);
+            entry->uid_len = uid_len;
+            // The filament sectors only, dumps extend the entry when they need more
+            BambuKdf kdf;
+            bambu_kdf_init(&kdf, uid, uid_len);
+            entry->key_count = bambu_kdf_get_keys(&kdf, 2, &entry->keys);
+            added++;
+        }
+        if(added > 0) cache->dirty = true;
+        furi_mutex_release(cache->mutex);
+    }
+
+    if(added > 0) {
+        FURI_LOG_I(TAG, "Key cache: warmed %u saved tags", added);
+    }
+}
+
+bool key_cache_get(
+    KeyCache* cache,
+    const uint8_t* uid,
+    uint8_t uid_len,
+    uint8_t sector_count,
+    BambuKeys* keys) {
+    furi_check(uid_len <= sizeof(cache->entries[0].uid));
+    furi_check(sector_count <= BAMBU_NUM_SECTORS);
+
+    furi_mutex_acquire(cache->mutex, FuriWaitForever);
+    int32_t index = key_cache_find(cache, uid, uid_len);
+    KeyCacheEntry entry;
+    bool found = index >= 0;
+
+    if(found) {
+        entry = cache->entries[index];
+    } else {
+        memset(&entry, 0, sizeof(entry));
+        memcpy(entry.uid, uid, uid_len);
+        entry.uid_len = uid_len;
+
+        // The least recently used entry drops off the end when full
+        index = (cache->count < KEY_CACHE_SIZE) ? cache->count++ : KEY_CACHE_SIZE - 1;
+    }
+
+    bool hit = found && entry.key_count >= sector_count;
+    if(hit) {
+        cache->hits++;
+    } else {
+        BambuKdf kdf;
+        bambu_kdf_init(&kdf, uid, uid_len);
+        entry.key_count = bambu_kdf_get_keys(&kdf, sector_count, &entry.keys);
+        cache->misses++;
+        cache->dirty = true;
+    }
+
+    // Move to front
+    if(index > 0) {
+        memmove(&cache->entries[1], &cache->entries[0], index * sizeof(KeyCacheEntry));
+        cache->dirty = true;
+    }
+    cache->entries[0] = entry;
+    furi_mutex_release(cache->mutex);
+
+    memcpy(keys, &entry.keys, sizeof(BambuKeys));
+    return hit;
+}
@@ -0,0 +1,47 @@
+/**
+ * @file key_cache.h
+ * @brief UID-keyed cache of derived sector keys, kept in RAM and on SD
+ * @author Tai Nguyen <taiducnguyen.drexel@gmail.com>
+ */
+
+#pragma once
+
+#include "bambu_tagger.h"
+
+// Entries kept in RAM and on SD, 108 bytes each (a BAMBU_UID_MAX_LEN UID,
+// two counts and 16 keys): 128 entries hold about 13.8 KB of heap for the
+// whole app run. A miss costs one key derivation, well under a millisecond
+// (see tools/bambu_keygen bench), so a smaller cache trades little speed
+// for RAM.
+#ifndef KEY_CACHE_SIZE
+#define KEY_CACHE_SIZE 128
+#endif
+
+#define KEY_CACHE_PATH BAMBU_TAGGER_FOLDER "/keys.cache"
+
+// Allocate an empty cache
+KeyCache* key_cache_alloc(void);
+
+// Free the cache, logs the hit rate. Call key_cache_save() first to keep it.
+void key_cache_free(KeyCache* cache);
+
+// Replace the cache contents with the file on SD, false if missing or corrupt
+bool key_cache_load(KeyCache* cache, Storage* storage);
+
+// Write the cache to SD if it changed since it was loaded. Call it once the
+// NFC thread and the storage worker have stopped.
+bool key_cache_save(KeyCache* cache, Storage* storage);
+
+// Fill free slots with the keys of saved tags that are not cached yet
+void key_cache_warm(KeyCache* cache, App* app);
+
+// Keys of sectors 0..sector_count-1 for a UID, derived and cached on a miss.
+// Only the expand blocks those sectors need are computed, keys past them are
+// left zeroed. Returns true on a hit. Called from the NFC thread while the
+// storage worker may still be loading or warming the cache.
+bool key_cache_get(
+    KeyCache* cache,
+    const uint8_t* uid,
+    uint8_t uid_len,
+    uint8_t sector_count,
+    BambuKeys* keys);
@@ -5,108 +5,390 @@
  */
 
 #include "nfc_operations.h"
+#include "nfc_session.h"
+#include "block_plan.h"
+#include "key_cache.h"
+
+// Authenticate to a sector with key A inside the current poller session.
+// The first auth of a session is a plain AUTH; once a Crypto1 session is
+// running the card only accepts an encrypted (nested) AUTH, so every later
+// sector goes through mf_classic_poller_auth_nested instead.
+static MfClassicError
+    sector_auth(MfClassicPoller* poller, uint8_t sector, const uint8_t* key_data, bool* authenticated) {
+    MfClassicKey key;
+    MfClassicAuthContext auth_ctx;
+    MfClassicError err;
+    uint8_t first_block = sector * 4;
+
+    memcpy(key.data, key_data, MF_CLASSIC_KEY_SIZE);
+    if(*authenticated) {
+        err = mf_classic_poller_auth_nested(
+            poller, first_block, &key, MfClassicKeyTypeA, &auth_ctx, false, false);
+    } else {
+        err = mf_classic_poller_auth(poller, first_block, &key, MfClassicKeyTypeA, &auth_ctx, false);
+    }
+    *authenticated = (err == MfClassicErrorNone);
+    return err;
+}
+
+// Timeouts and CRC/parity errors (reported as protocol errors) are usually one
+// bad frame. A missing card or a wrong key is not retried.
+static bool retryable_error(MfClassicError err) {
+    return err == MfClassicErrorTimeout || err == MfClassicErrorProtocol;
+}
+
+// The Crypto1 state is lost after a bad frame: count the retry, back off and
+// halt the card so the next plain AUTH re-activates it
+static void retry_backoff(App* app, MfClassicPoller* poller, uint8_t attempt, MfClassicError err) {
+    app->nfc_retries++;
+    FURI_LOG_W(TAG, "Transient error %d, retry %d/%d", err, attempt, NFC_RETRY_LIMIT);
+    furi_delay_ms(NFC_RETRY_BACKOFF_MS * attempt);
+    mf_classic_poller_halt(poller);
+}
 
-// Track which sector to read/write (0 or 1) - managed by scene handler
-uint8_t g_current_read_sector = 0;
-uint8_t g_current_write_sector = 0;
+// sector_auth with bounded retry on transient errors
+static MfClassicError sector_auth_retry(
+    App* app,
+    MfClassicPoller* poller,
+    uint8_t sector,
+    const uint8_t* key_data,
+    bool* authenticated) {
+    MfClassicError err = sector_auth(poller, sector, key_data, authenticated);
+    for(uint8_t attempt = 1; attempt <= NFC_RETRY_LIMIT && retryable_error(err); attempt++) {
+        retry_backoff(app, poller, attempt, err);
+        *authenticated = false;
+        err = sector_auth(poller, sector, key_data, authenticated);
+    }
+    return err;
+}
+
+// Read or write a block, re-authenticating its sector and retrying on transient
+// errors. alt_key is tried when key_data no longer authenticates, which happens
+// when a trailer write reached the card but its ACK was lost.
+static MfClassicError block_io_retry(
+    App* app,
+    MfClassicPoller* poller,
+    bool write,
+    uint8_t block,
+    MfClassicBlock* data,
+    const uint8_t* key_data,
+    const uint8_t* alt_key,
+    bool* authenticated) {
+    MfClassicError err = write ? mf_classic_poller_write_block(poller, block, data) :
+                                 mf_classic_poller_read_block(poller, block, data);
+
+    for(uint8_t attempt = 1; attempt <= NFC_RETRY_LIMIT && retryable_error(err); attempt++) {
+        retry_backoff(app, poller, attempt, err);
+        *authenticated = false;
+        err = sector_auth(poller, block / 4, key_data, authenticated);
+        if(err == MfClassicErrorAuth && alt_key != NULL) {
+            mf_classic_poller_halt(poller);
+            err = sector_auth(poller, block / 4, alt_key, authenticated);
+            if(err == MfClassicErrorNone) {
+                key_data = alt_key;
+            }
+        }
+        if(err == MfClassicErrorNone) {
+            err = write ? mf_classic_poller_write_block(poller, block, data) :
+                          mf_classic_poller_read_block(poller, block, data);
+        }
+    }
+    return err;
+}
 
 void scanner_callback(NfcScannerEvent event, void* context) {
     App* app = context;
     if(event.type == NfcScannerEventTypeDetected) {
-        app->card_detected = true;
+        view_dispatcher_send_custom_event(app->view_dispatcher, EventTagDetected);
     }
 }
 
-NfcCommand uid_poller_callback(NfcGenericEvent event, void* context) {
-    App* app = context;
+static const uint8_t default_key[MF_CLASSIC_KEY_SIZE] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+// Copy the UID out of the MfClassic poller and derive the keys of sectors
+// 0..sector_count-1 for it.
+// The poller copies the anticollision data into its MfClassicData while it
+// detects the card type, which happens before RequestMode and after
+// CardDetected, so this must be called from the RequestMode event.
+static bool session_load_uid(App* app, uint8_t sector_count) {
+    NfcPoller* nfc_poller = nfc_session_get_poller(app->nfc_session);
+    const MfClassicData* data = nfc_poller_get_data(nfc_poller);
+    size_t uid_len = 0;
+    const uint8_t* uid = mf_classic_get_uid(data, &uid_len);
+
+    if(uid == NULL || uid_len == 0 || uid_len > sizeof(app->tag_data.uid)) {
+        FURI_LOG_E(TAG, "No UID from MfClassic poller");
+        return false;
+    }
 
-    if(event.protocol == NfcProtocolIso14443_3a) {
-        const Iso14443_3aPollerEvent* iso_event = event.event_data;
-        FURI_LOG_D(TAG, "ISO14443-3A event type: %d", iso_event->type);
-
-        if(iso_event->type == Iso14443_3aPollerEventTypeReady) {
-            // Get the data from the poller instance
-            const Iso14443_3aData* data = nfc_poller_get_data(app->poller);
-            if(data) {
-                app->tag_data.uid_len = data->uid_len;
-                memcpy(app->tag_data.uid, data->uid, app->tag_data.uid_len);
-                app->uid_read = true;
-                FURI_LOG_I(TAG, "UID read successfully, len=%d", data->uid_len);
-            }
-            return NfcCommandStop;
+    memcpy(app->tag_data.uid, uid, uid_len);
+    app->tag_data.uid_len = uid_len;
+    FURI_LOG_I(TAG, "UID read successfully, len=%d", app->tag_data.uid_len);
+
+    memset(&app->derived_keys, 0, sizeof(BambuKeys));
+    bool cached = key_cache_get(
+        app->key_cache, app->tag_data.uid, app->tag_data.uid_len, sector_count, &app->derived_keys);
+    FURI_LOG_I(
+        TAG,
+        "Key[0] (%s): %02X %02X %02X %02X %02X %02X",
+        cached ? "cached" : "derived",
+        app->derived_keys.keys[0][0],
+        app->derived_keys.keys[0][1],
+        app->derived_keys.keys[0][2],
+        app->derived_keys.keys[0][3],
+        app->derived_keys.keys[0][4],
+        app->derived_keys.keys[0][5]);
+    return true;
+}
+
+// Compare a target block with what was read from the card. Key A never reads
+// back from a trailer, so trailers compare access bits, user byte and key B,
+// and key A counts as matching when the sector was authenticated with it.
+static bool write_block_matches(
+    uint8_t block,
+    const MfClassicBlock* target,
+    const MfClassicBlock* card,
+    const uint8_t* auth_key) {
+    if(block % 4 == 3) {
+        return memcmp(target->data, auth_key, MF_CLASSIC_KEY_SIZE) == 0 &&
+               memcmp(&target->data[6], &card->data[6], 10) == 0;
+    }
+    return memcmp(target->data, card->data, 16) == 0;
+}
+
+// FNV-1a over the target image, a journal only resumes the plan it was made for
+static uint32_t write_plan_hash(App* app, const BlockPlan* plan) {
+    MfClassicBlock block_data;
+    uint32_t hash = 2166136261u;
+
+    for(uint8_t i = 0; i < plan->count; i++) {
+        block_plan_prepare(app, &plan->entries[i], &block_data);
+        hash ^= plan->entries[i].block;
+        hash *= 16777619u;
+        for(size_t j = 0; j < sizeof(block_data.data); j++) {
+            hash ^= block_data.data[j];
+            hash *= 16777619u;
         }
     }
-    return NfcCommandContinue;
+    return hash;
 }
 
-NfcCommand detect_tag_type_callback(NfcGenericEvent event, void* context) {
-    App* app = context;
+// Resume the journal if it belongs to this UID and plan, otherwise start a new one
+static void write_journal_begin(App* app, uint32_t plan_hash) {
+    WriteJournal* journal = &app->write_journal;
+
+    if(journal->active && journal->plan_hash == plan_hash &&
+       journal->uid_len == app->tag_data.uid_len &&
+       memcmp(journal->uid, app->tag_data.uid, journal->uid_len) == 0) {
+        FURI_LOG_I(
+            TAG,
+            "Resuming write journal, done=%08lX%08lX",
+            (unsigned long)(journal->done_blocks >> 32),
+            (unsigned long)(journal->done_blocks & 0xFFFFFFFFUL));
+        return;
+    }
 
-    if(event.protocol == NfcProtocolMfClassic) {
-        const MfClassicPollerEvent* mf_event = event.event_data;
-        MfClassicPoller* poller = event.instance;
+    journal->active = true;
+    memcpy(journal->uid, app->tag_data.uid, app->tag_data.uid_len);
+    journal->uid_len = app->tag_data.uid_len;
+    // Sector 0 was authenticated by the tag type detection
+    journal->known_sectors = 1 << 0;
+    journal->blank_sectors = app->write_to_blank ? 1 << 0 : 0;
+    journal->plan_hash = plan_hash;
+    journal->done_blocks = 0;
+}
 
-        if(mf_event->type == MfClassicPollerEventTypeRequestMode) {
-            MfClassicPollerEventDataRequestMode* mode_data = &mf_event->data->poller_mode;
-            mf_classic_reset(app->mf_data);
-            app->mf_data->type = MfClassicType1k;
-            mode_data->mode = MfClassicPollerModeRead;
-            mode_data->data = app->mf_data;
-            return NfcCommandContinue;
+// Key A currently on a sector: derived once its trailer is written, otherwise
+// whatever the tag had when the write started. A sector not authenticated
+// yet is guessed to be like sector 0.
+static const uint8_t* write_journal_sector_key(App* app, uint8_t sector) {
+    const WriteJournal* journal = &app->write_journal;
+    uint16_t blank = (journal->known_sectors & (1 << sector)) ?
+                         journal->blank_sectors & (1 << sector) :
+                         journal->blank_sectors & (1 << 0);
+
+    if((journal->done_blocks & (1ULL << (sector * 4 + 3))) || !blank) {
+        return app->derived_keys.keys[sector];
+    }
+    return default_key;
+}
+
+// Key A for a plan entry's sector
+static const uint8_t* plan_entry_key(App* app, const PlanEntry* entry) {
+    if(entry->key == PlanKeyCurrent) {
+        return write_journal_sector_key(app, entry->block / 4);
+    }
+    return app->derived_keys.keys[entry->block / 4];
+}
+
+// Authenticate a write plan sector and record the key it started with. A
+// sector whose key is not known yet falls back to the other of the derived
+// and default keys, as the tag type detection does for sector 0.
+static MfClassicError write_sector_auth(
+    App* app,
+    MfClassicPoller* poller,
+    const PlanEntry* entry,
+    const uint8_t** auth_key,
+    bool* authenticated) {
+    WriteJournal* journal = &app->write_journal;
+    uint8_t sector = entry->block / 4;
+    uint16_t bit = 1 << sector;
+
+    *auth_key = plan_entry_key(app, entry);
+    MfClassicError err = sector_auth_retry(app, poller, sector, *auth_key, authenticated);
+    if(err == MfClassicErrorAuth && entry->key == PlanKeyCurrent && !(journal->known_sectors & bit)) {
+        // The failed AUTH ended the Crypto1 session, halt so the plain AUTH re-activates the card
+        mf_classic_poller_halt(poller);
+        *authenticated = false;
+        *auth_key = (*auth_key == default_key) ? app->derived_keys.keys[sector] : default_key;
+        err = sector_auth_retry(app, poller, sector, *auth_key, authenticated);
+    }
+    if(err == MfClassicErrorNone && !(journal->known_sectors & bit)) {
+        journal->known_sectors |= bit;
+        if(*auth_key == default_key) {
+            journal->blank_sectors |= bit;
+        } else {
+            journal->blank_sectors &= ~bit;
         }
+        FURI_LOG_I(
+            TAG,
+            "Sector %d starts with the %s key",
+            sector,
+            *auth_key == default_key ? "default" : "derived");
+    }
+    return err;
+}
 
-        if(mf_event->type == MfClassicPollerEventTypeCardDetected) {
-            // Try to authenticate sector 0 with Bambu-derived key
-            MfClassicKey key;
-            MfClassicAuthContext auth_ctx;
-            memcpy(key.data, app->derived_keys.keys[0], MF_CLASSIC_KEY_SIZE);
+// Auth errors mean the plan is wrong for this tag; anything else is the tag
+// leaving the field and can be resumed
+static void write_post_error(App* app, MfClassicError err) {
+    view_dispatcher_send_custom_event(
+        app->view_dispatcher,
+        err == MfClassicErrorAuth ? EventWriteFailed : EventWriteInterrupted);
+}
 
-            MfClassicError err = mf_classic_poller_auth(poller, 0, &key, MfClassicKeyTypeA, &auth_ctx, false);
+// Decide between a blank (or self-programmed) tag and an original Bambu tag at
+// the start of the write session. Sector 0 is left authenticated with the key
+// that worked, returned in *sector0_key, so writing carries on without a new
+// activation. Original Bambu tags are rejected before anything is written.
+static TagType write_detect_tag_type(
+    App* app,
+    MfClassicPoller* poller,
+    bool* authenticated,
+    const uint8_t** sector0_key,
+    MfClassicError* error) {
+    MfClassicBlock trailer;
+
+    *error = sector_auth_retry(app, poller, 0, app->derived_keys.keys[0], authenticated);
+    if(*error == MfClassicErrorNone) {
+        // Bambu keys worked - now check if access bits are read-only
+        FURI_LOG_I(TAG, "Detection: Bambu key auth succeeded, checking access bits...");
+        *sector0_key = app->derived_keys.keys[0];
+
+        // Access bits are in bytes 6-8 of the trailer, ours are FF 07 80
+        *error = block_io_retry(
+            app, poller, false, 3, &trailer, app->derived_keys.keys[0], NULL, authenticated);
+        if(*error != MfClassicErrorNone) {
+            // Couldn't read trailer - assume original Bambu tag
+            FURI_LOG_W(TAG, "Couldn't read sector trailer, assuming Bambu tag");
+            return TagTypeBambu;
+        }
 
-            if(err == MfClassicErrorNone) {
-                // Bambu keys worked - now check if access bits are read-only
-                FURI_LOG_I(TAG, "Detection: Bambu key auth succeeded, checking access bits...");
-
-                // Read sector trailer (block 3) to check access bits
-                MfClassicBlock trailer;
-                err = mf_classic_poller_read_block(poller, 3, &trailer);
-
-                if(err == MfClassicErrorNone) {
-                    // Access bits are in bytes 6-8 of the trailer
-                    // Default (writable): FF 07 80
-                    // We check if it matches our writable pattern
-                    bool is_writable = (trailer.data[6] == 0xFF &&
-                                       trailer.data[7] == 0x07 &&
-                                       trailer.data[8] == 0x80);
-
-                    FURI_LOG_I(TAG, "Access bits: %02X %02X %02X - %s",
-                        trailer.data[6], trailer.data[7], trailer.data[8],
-                        is_writable ? "writable" : "read-only");
-
-                    if(is_writable) {
-                        // Tag we programmed - can be reprogrammed
-                        app->detected_tag_type = TagTypeBlank;
-                        app->write_to_blank = false;  // Use Bambu keys for auth
-                    } else {
-                        // Original Bambu tag with restrictive access bits
-                        app->detected_tag_type = TagTypeBambu;
-                    }
-                } else {
-                    // Couldn't read trailer - assume original Bambu tag
-                    FURI_LOG_W(TAG, "Couldn't read sector trailer, assuming Bambu tag");
-                    app->detected_tag_type = TagTypeBambu;
-                }
-            } else {
-                // Bambu keys failed - assume blank tag with default keys
-                FURI_LOG_I(TAG, "Detection: Bambu key auth failed - assuming blank tag");
-                app->detected_tag_type = TagTypeBlank;
-                app->write_to_blank = true;  // Use default keys for auth
-            }
-            app->detection_in_progress = false;
-            return NfcCommandStop;
+        bool is_writable =
+            (trailer.data[6] == 0xFF && trailer.data[7] == 0x07 && trailer.data[8] == 0x80);
+        FURI_LOG_I(
+            TAG,
+            "Access bits: %02X %02X %02X - %s",
+            trailer.data[6],
+            trailer.data[7],
+            trailer.data[8],
+            is_writable ? "writable" : "read-only");
+        if(!is_writable) {
+            // Original Bambu tag with restrictive access bits
+            return TagTypeBambu;
         }
+
+        // Tag we programmed - can be reprogrammed with the Bambu keys
+        app->write_to_blank = false;
+        return TagTypeBlank;
     }
-    return NfcCommandContinue;
+    if(*error != MfClassicErrorAuth) {
+        return TagTypeUnknown;
+    }
+
+    // Bambu keys failed - a blank tag has the default key. The failed AUTH
+    // ended the Crypto1 session, halt so the plain AUTH re-activates the card.
+    FURI_LOG_I(TAG, "Detection: Bambu key auth failed - trying default key");
+    mf_classic_poller_halt(poller);
+    *authenticated = false;
+    *error = sector_auth_retry(app, poller, 0, default_key, authenticated);
+    if(*error != MfClassicErrorNone) {
+        return TagTypeUnknown;
+    }
+    *sector0_key = default_key;
+    app->write_to_blank = true;
+    return TagTypeBlank;
+}
+
+bool batch_uid_seen(const App* app) {
+    const BatchState* batch = &app->batch;
+    for(uint16_t i = 0; i < batch->uid_count; i++) {
+        if(batch->uid_lens[i] == app->tag_data.uid_len &&
+           memcmp(batch->uids[i], app->tag_data.uid, app->tag_data.uid_len) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// FNV-1a of the UID picks the first slot to look at
+static uint32_t inventory_uid_slot(const App* app) {
+    uint32_t hash = 2166136261u;
+    for(uint8_t i = 0; i < app->tag_data.uid_len; i++) {
+        hash ^= app->tag_data.uid[i];
+        hash *= 16777619u;
+    }
+    return hash & (INVENTORY_UID_SLOTS - 1);
+}
+
+// Slot holding the current UID, or the empty slot where it goes. Full UIDs
+// are compared, tags whose hashes collide are still told apart.
+static uint32_t inventory_uid_find(const App* app) {
+    const InventoryState* inventory = app->inventory;
+    uint32_t slot = inventory_uid_slot(app);
+
+    while(inventory->uids[slot].uid_len != 0) {
+        const InventoryUid* entry = &inventory->uids[slot];
+        if(entry->uid_len == app->tag_data.uid_len &&
+           memcmp(entry->uid, app->tag_data.uid, entry->uid_len) == 0) {
+            break;
+        }
+        slot = (slot + 1) & (INVENTORY_UID_SLOTS - 1);
+    }
+    return slot;
+}
+
+bool inventory_uid_seen(const App* app) {
+    return app->inventory->uids[inventory_uid_find(app)].uid_len != 0;
+}
+
+bool inventory_uid_add(App* app) {
+    InventoryState* inventory = app->inventory;
+    // The scene stops the sweep before the set fills up
+    furi_check(!inventory_uid_full(app));
+    furi_check(app->tag_data.uid_len > 0 && app->tag_data.uid_len <= sizeof(inventory->uids[0].uid));
+
+    InventoryUid* entry = &inventory->uids[inventory_uid_find(app)];
+    if(entry->uid_len != 0) return false;
+
+    entry->uid_len = app->tag_data.uid_len;
+    memcpy(entry->uid, app->tag_data.uid, entry->uid_len);
+    inventory->count++;
+    return true;
+}
+
+bool inventory_uid_full(const App* app) {
+    return app->inventory->count >= INVENTORY_MAX_UIDS;
 }
 
 NfcCommand write_poller_callback(NfcGenericEvent event, void* context) {
@@ -118,175 +400,232 @@ NfcCommand write_poller_callback(NfcGenericEvent event, void* context) {
 
         if(mf_event->type == MfClassicPollerEventTypeRequestMode) {
             MfClassicPollerEventDataRequestMode* mode_data = &mf_event->data->poller_mode;
-            mf_classic_reset(app->mf_data);
-            app->mf_data->type = MfClassicType1k;
             mode_data->mode = MfClassicPollerModeRead;  // Use read mode, we'll write manually
             mode_data->data = app->mf_data;
-            FURI_LOG_I(TAG, "Write: RequestMode, sector=%d, write_to_blank=%d",
-                g_current_write_sector, app->write_to_blank);
-            return NfcCommandContinue;
-        }
-
-        if(mf_event->type == MfClassicPollerEventTypeCardDetected) {
-            FURI_LOG_I(TAG, "Write: Card detected, writing sector %d", g_current_write_sector);
 
-            MfClassicKey auth_key;
-            MfClassicAuthContext auth_ctx;
             MfClassicBlock block_data;
+            MfClassicBlock card_data;
             MfClassicError err;
-
-            uint8_t sector = g_current_write_sector;
-            uint8_t first_block = sector * 4;  // Sector 0 -> block 0, Sector 1 -> block 4
-
-            // Determine which key to use for authentication
-            if(app->write_to_blank) {
-                memset(auth_key.data, 0xFF, MF_CLASSIC_KEY_SIZE);
-                FURI_LOG_I(TAG, "Using default key FFFFFFFFFFFF");
-            } else {
-                memcpy(auth_key.data, app->derived_keys.keys[sector], MF_CLASSIC_KEY_SIZE);
-            }
-
-            // Authenticate to sector
-            FURI_LOG_I(TAG, "Authenticating sector %d (block %d)...", sector, first_block);
-            err = mf_classic_poller_auth(poller, first_block, &auth_key, MfClassicKeyTypeA, &auth_ctx, false);
-
-            if(err != MfClassicErrorNone) {
-                FURI_LOG_E(TAG, "Sector %d auth failed: %d", sector, err);
-                app->write_in_progress = false;
-                return NfcCommandStop;
-            }
-
-            FURI_LOG_I(TAG, "Sector %d auth OK", sector);
-
-            // Prepare and write blocks for this sector
-            if(sector == 0) {
-                // Write blocks 1 and 2
-                if(app->use_saved_tag) {
-                    memcpy(block_data.data, app->read_data.block1, 16);
-                } else {
-                    const FilamentInfo* filament = &BAMBU_FILAMENTS[app->tag_data.filament_index];
-                    prepare_block1(block_data.data, filament);
-                }
-                FURI_LOG_I(TAG, "Writing block 1...");
-                err = mf_classic_poller_write_block(poller, 1, &block_data);
-                if(err != MfClassicErrorNone) {
-                    FURI_LOG_E(TAG, "Block 1 write failed: %d", err);
-                    app->write_in_progress = false;
+            const uint8_t* auth_key = NULL;
+            bool is_trailer;
+            bool authenticated = false;
+            bool mismatch = false;
+            uint8_t sector = 0xFF;
+            app->nfc_retries = 0;
+
+            // Sectors 0 and 1 always; a loaded full dump also clones sectors 2-15
+            BlockPlan plan;
+            block_plan_build_write(app, &plan);
+
+            if(app->write_detect) {
+                // Fused detect-and-write: UID, keys and tag type come from this session
+                app->detected_tag_type = TagTypeUnknown;
+                if(!session_load_uid(app, block_plan_sector_count(&plan))) {
+                    view_dispatcher_send_custom_event(app->view_dispatcher, EventTagTypeDetected);
                     return NfcCommandStop;
                 }
-                FURI_LOG_I(TAG, "Block 1 write OK");
-
-                if(app->use_saved_tag) {
-                    memcpy(block_data.data, app->read_data.block2, 16);
-                } else {
-                    const FilamentInfo* filament = &BAMBU_FILAMENTS[app->tag_data.filament_index];
-                    prepare_block2(block_data.data, filament);
-                }
-                FURI_LOG_I(TAG, "Writing block 2...");
-                err = mf_classic_poller_write_block(poller, 2, &block_data);
-                if(err != MfClassicErrorNone) {
-                    FURI_LOG_E(TAG, "Block 2 write failed: %d", err);
-                    app->write_in_progress = false;
+                app->detected_tag_type =
+                    write_detect_tag_type(app, poller, &authenticated, &auth_key, &err);
+                if(app->detected_tag_type == TagTypeUnknown && err == MfClassicErrorAuth) {
+                    // Neither the Bambu nor the default key opens sector 0
+                    app->write_status[1] = WriteBlockStatusFailed;
+                    view_dispatcher_send_custom_event(app->view_dispatcher, EventWriteFailed);
                     return NfcCommandStop;
                 }
-                FURI_LOG_I(TAG, "Block 2 write OK");
-
-                // Write sector 0 trailer (block 3) with Bambu-derived keys
-                memset(block_data.data, 0, 16);
-                memcpy(block_data.data, app->derived_keys.keys[0], 6);  // Key A
-                block_data.data[6] = 0xFF;  // Access bits
-                block_data.data[7] = 0x07;
-                block_data.data[8] = 0x80;
-                block_data.data[9] = 0x69;
-                memcpy(&block_data.data[10], app->derived_keys.keys[0], 6);  // Key B
-                FURI_LOG_I(TAG, "Writing sector 0 trailer (block 3)...");
-                err = mf_classic_poller_write_block(poller, 3, &block_data);
-                if(err != MfClassicErrorNone) {
-                    FURI_LOG_E(TAG, "Block 3 write failed: %d", err);
-                    app->write_in_progress = false;
+                if(app->detected_tag_type != TagTypeBlank ||
+                   (app->batch_active && batch_uid_seen(app))) {
+                    view_dispatcher_send_custom_event(app->view_dispatcher, EventTagTypeDetected);
                     return NfcCommandStop;
                 }
-                FURI_LOG_I(TAG, "Block 3 (sector trailer) write OK");
             } else {
-                // Write blocks 4 and 5
-                if(app->use_saved_tag) {
-                    memcpy(block_data.data, app->read_data.block4, 16);
-                } else {
-                    const FilamentInfo* filament = &BAMBU_FILAMENTS[app->tag_data.filament_index];
-                    prepare_block4(block_data.data, filament);
-                }
-                FURI_LOG_I(TAG, "Writing block 4...");
-                err = mf_classic_poller_write_block(poller, 4, &block_data);
-                if(err != MfClassicErrorNone) {
-                    FURI_LOG_E(TAG, "Block 4 write failed: %d", err);
-                    app->write_in_progress = false;
+                // Resuming: the keys were derived for the detected tag, only write to that UID
+                NfcPoller* nfc_poller = nfc_session_get_poller(app->nfc_session);
+                const MfClassicData* data = nfc_poller_get_data(nfc_poller);
+                size_t uid_len = 0;
+                const uint8_t* uid = mf_classic_get_uid(data, &uid_len);
+                if(uid == NULL || uid_len != app->tag_data.uid_len ||
+                   memcmp(uid, app->tag_data.uid, uid_len) != 0) {
+                    FURI_LOG_W(TAG, "Write: different tag presented");
+                    view_dispatcher_send_custom_event(app->view_dispatcher, EventWriteWrongTag);
                     return NfcCommandStop;
                 }
-                FURI_LOG_I(TAG, "Block 4 write OK");
+            }
 
-                if(app->use_saved_tag) {
-                    memcpy(block_data.data, app->read_data.block5, 16);
+            write_journal_begin(app, write_plan_hash(app, &plan));
+            WriteJournal* journal = &app->write_journal;
+            FURI_LOG_I(
+                TAG,
+                "Write: %d blocks in %d sectors, blank=%d",
+                plan.count,
+                plan.auth_count,
+                app->write_to_blank);
+
+            // Carry on in the sector detection authenticated, unless the
+            // journal expects a different key there
+            if(authenticated) {
+                if(memcmp(auth_key, write_journal_sector_key(app, 0), MF_CLASSIC_KEY_SIZE) == 0) {
+                    sector = 0;
                 } else {
-                    const ColorPreset* color = &COLOR_PRESETS[app->tag_data.color_index];
-                    prepare_block5(block_data.data, color, app->tag_data.weight_grams);
+                    mf_classic_poller_halt(poller);
+                    authenticated = false;
+                }
+            }
+
+            for(uint8_t i = 0; i < plan.count; i++) {
+                const PlanEntry* entry = &plan.entries[i];
+                uint8_t block = entry->block;
+
+                // Already on the card from an earlier, interrupted attempt
+                if(journal->done_blocks & (1ULL << block)) {
+                    if(app->write_status[block] == WriteBlockStatusPending) {
+                        app->write_status[block] = WriteBlockStatusSkipped;
+                    }
+                    continue;
                 }
-                FURI_LOG_I(TAG, "Writing block 5...");
-                err = mf_classic_poller_write_block(poller, 5, &block_data);
+
+                // Authenticate once per sector, nested after the first one
+                if(block / 4 != sector) {
+                    sector = block / 4;
+
+                    FURI_LOG_I(TAG, "Authenticating sector %d (block %d)...", sector, sector * 4);
+                    err = write_sector_auth(app, poller, entry, &auth_key, &authenticated);
+                    if(err != MfClassicErrorNone) {
+                        FURI_LOG_E(TAG, "Sector %d auth failed: %d", sector, err);
+                        app->write_status[block] = WriteBlockStatusFailed;
+                        write_post_error(app, err);
+                        return NfcCommandStop;
+                    }
+                    FURI_LOG_I(TAG, "Sector %d auth OK", sector);
+                }
+
+                block_plan_prepare(app, entry, &block_data);
+                is_trailer = (block % 4 == 3);
+
+                // Read first and leave blocks that already hold the target data alone
+                err = block_io_retry(
+                    app, poller, false, block, &card_data, auth_key, NULL, &authenticated);
                 if(err != MfClassicErrorNone) {
-                    FURI_LOG_E(TAG, "Block 5 write failed: %d", err);
-                    app->write_in_progress = false;
+                    FURI_LOG_E(TAG, "Block %d read failed: %d", block, err);
+                    app->write_status[block] = WriteBlockStatusFailed;
+                    write_post_error(app, err);
                     return NfcCommandStop;
                 }
-                FURI_LOG_I(TAG, "Block 5 write OK");
-
-                // Write block 6 (manufacturer)
-                if(app->use_saved_tag) {
-                    memcpy(block_data.data, app->read_data.block6, 16);
-                } else {
-                    const ManufacturerPreset* manufacturer = &MANUFACTURER_PRESETS[app->tag_data.manufacturer_index];
-                    prepare_block6(block_data.data, manufacturer);
+                if(write_block_matches(block, &block_data, &card_data, auth_key)) {
+                    app->write_status[block] = WriteBlockStatusSkipped;
+                    journal->done_blocks |= 1ULL << block;
+                    FURI_LOG_I(TAG, "Block %d unchanged, skipped", block);
+                    continue;
                 }
-                FURI_LOG_I(TAG, "Writing block 6...");
-                err = mf_classic_poller_write_block(poller, 6, &block_data);
+
+                FURI_LOG_I(TAG, "Writing block %d...", block);
+                err = block_io_retry(
+                    app,
+                    poller,
+                    true,
+                    block,
+                    &block_data,
+                    auth_key,
+                    is_trailer ? block_data.data : NULL,
+                    &authenticated);
                 if(err != MfClassicErrorNone) {
-                    FURI_LOG_E(TAG, "Block 6 write failed: %d", err);
-                    app->write_in_progress = false;
+                    FURI_LOG_E(TAG, "Block %d write failed: %d", block, err);
+                    app->write_status[block] = WriteBlockStatusFailed;
+                    write_post_error(app, err);
                     return NfcCommandStop;
                 }
-                FURI_LOG_I(TAG, "Block 6 write OK");
-
-                // Write sector 1 trailer (block 7) with Bambu-derived keys
-                memset(block_data.data, 0, 16);
-                memcpy(block_data.data, app->derived_keys.keys[1], 6);  // Key A
-                block_data.data[6] = 0xFF;  // Access bits
-                block_data.data[7] = 0x07;
-                block_data.data[8] = 0x80;
-                block_data.data[9] = 0x69;
-                memcpy(&block_data.data[10], app->derived_keys.keys[1], 6);  // Key B
-                FURI_LOG_I(TAG, "Writing sector 1 trailer (block 7)...");
-                err = mf_classic_poller_write_block(poller, 7, &block_data);
+                app->write_status[block] = WriteBlockStatusWritten;
+
+                // Read back to catch writes the card acknowledged but did not store.
+                // The sector stays authenticated even after its trailer is rewritten.
+                // A re-auth here needs the new key A once the trailer is on the card.
+                err = block_io_retry(
+                    app,
+                    poller,
+                    false,
+                    block,
+                    &card_data,
+                    is_trailer ? block_data.data : auth_key,
+                    is_trailer ? auth_key : NULL,
+                    &authenticated);
                 if(err != MfClassicErrorNone) {
-                    FURI_LOG_E(TAG, "Block 7 write failed: %d", err);
-                    app->write_in_progress = false;
+                    FURI_LOG_E(TAG, "Block %d read-back failed: %d", block, err);
+                    write_post_error(app, err);
                     return NfcCommandStop;
                 }
-                FURI_LOG_I(TAG, "Block 7 (sector trailer) write OK");
+                if(write_block_matches(block, &block_data, &card_data, block_data.data)) {
+                    app->write_status[block] = WriteBlockStatusVerified;
+                    journal->done_blocks |= 1ULL << block;
+                    FURI_LOG_I(TAG, "Block %d write verified", block);
+                } else {
+                    app->write_status[block] = WriteBlockStatusMismatch;
+                    mismatch = true;
+                    FURI_LOG_E(TAG, "Block %d read-back mismatch", block);
+                }
             }
 
-            FURI_LOG_I(TAG, "Sector %d write complete", sector);
-            app->write_in_progress = false;
+            FURI_LOG_I(TAG, "Write complete, mismatch=%d, retries=%d", mismatch, app->nfc_retries);
+            journal->active = mismatch;  // A mismatched block is retried on the next attempt
+            app->write_success = !mismatch;
+            view_dispatcher_send_custom_event(
+                app->view_dispatcher, mismatch ? EventWriteFailed : EventWriteSuccess);
             return NfcCommandStop;
         }
 
         if(mf_event->type == MfClassicPollerEventTypeCardLost) {
             FURI_LOG_W(TAG, "Card lost during write");
-            app->write_in_progress = false;
+            view_dispatcher_send_custom_event(app->view_dispatcher, EventWriteInterrupted);
             return NfcCommandStop;
         }
     }
     return NfcCommandContinue;
 }
 
+// Run a read plan into App::mf_data, returns false if a required entry failed
+static bool plan_run_read(App* app, MfClassicPoller* poller, const BlockPlan* plan) {
+    MfClassicBlock block_data;
+    MfClassicError err;
+    const uint8_t* key = NULL;
+    bool authenticated = false;
+    bool success = true;
+    uint8_t sector = 0xFF;
+
+    for(uint8_t i = 0; i < plan->count; i++) {
+        const PlanEntry* entry = &plan->entries[i];
+        bool required = !(entry->flags & PLAN_FLAG_OPTIONAL);
+
+        // Entries are sorted, so each sector is authenticated once
+        if(entry->block / 4 != sector) {
+            sector = entry->block / 4;
+            key = plan_entry_key(app, entry);
+            err = sector_auth_retry(app, poller, sector, key, &authenticated);
+            if(err != MfClassicErrorNone) {
+                // The card dropped out of the Crypto1 session, the rest can't run
+                FURI_LOG_E(TAG, "Sector %d Auth Failed: %d", sector, err);
+                return false;
+            }
+            FURI_LOG_I(TAG, "Sector %d Auth OK", sector);
+        }
+
+        err = block_io_retry(app, poller, false, entry->block, &block_data, key, NULL, &authenticated);
+        if(err == MfClassicErrorNone) {
+            mf_classic_set_block_read(app->mf_data, entry->block, &block_data);
+            FURI_LOG_I(
+                TAG,
+                "Block %d: %02X %02X %02X %02X...",
+                entry->block,
+                block_data.data[0],
+                block_data.data[1],
+                block_data.data[2],
+                block_data.data[3]);
+        } else {
+            FURI_LOG_W(
+                TAG, "Block %d read failed: %d%s", entry->block, err, required ? "" : " (optional)");
+            if(required) success = false;
+        }
+    }
+    return success;
+}
+
 NfcCommand read_poller_callback(NfcGenericEvent event, void* context) {
     App* app = context;
 
@@ -299,84 +638,123 @@ NfcCommand read_poller_callback(NfcGenericEvent event, void* context) {
 
             mf_classic_reset(app->mf_data);
             app->mf_data->type = MfClassicType1k;
-            mf_classic_set_uid(app->mf_data, app->tag_data.uid, app->tag_data.uid_len);
 
             mode_data->mode = MfClassicPollerModeRead;
             mode_data->data = app->mf_data;
 
-            FURI_LOG_I(TAG, "RequestMode: will read sector %d", g_current_read_sector);
-            return NfcCommandContinue;
+            // UID, key derivation and both sectors all happen in this session
+            BlockPlan plan;
+            block_plan_build_read(&plan);
+            if(!session_load_uid(app, block_plan_sector_count(&plan))) {
+                view_dispatcher_send_custom_event(app->view_dispatcher, EventReadFailed);
+                return NfcCommandStop;
+            }
+            mf_classic_set_uid(app->mf_data, app->tag_data.uid, app->tag_data.uid_len);
+
+            // Inventory sweeps keep the tag in the field, don't read it again
+            if(app->inventory_active && inventory_uid_seen(app)) {
+                view_dispatcher_send_custom_event(app->view_dispatcher, EventReadDuplicate);
+                return NfcCommandStop;
+            }
+
+            // Filament blocks of sectors 0 and 1, one auth per sector
+            FURI_LOG_I(TAG, "RequestMode: reading %d blocks in %d sectors", plan.count, plan.auth_count);
+            app->nfc_retries = 0;
+            app->read_success = plan_run_read(app, poller, &plan);
+            FURI_LOG_I(TAG, "Read complete, retries=%d", app->nfc_retries);
+
+            // Blocks that were not read stay zeroed, a missing block 6 shows "Generic"
+            memcpy(app->read_data.block1, app->mf_data->block[1].data, 16);
+            memcpy(app->read_data.block2, app->mf_data->block[2].data, 16);
+            memcpy(app->read_data.block4, app->mf_data->block[4].data, 16);
+            memcpy(app->read_data.block5, app->mf_data->block[5].data, 16);
+            memcpy(app->read_data.block6, app->mf_data->block[6].data, 16);
+
+            view_dispatcher_send_custom_event(
+                app->view_dispatcher, app->read_success ? EventReadSuccess : EventReadFailed);
+            return NfcCommandStop;
         }
 
-        if(mf_event->type == MfClassicPollerEventTypeCardDetected) {
-            MfClassicKey key;
-            MfClassicAuthContext auth_ctx;
-            MfClassicBlock block_data;
-            MfClassicError err;
+        if(mf_event->type == MfClassicPollerEventTypeCardLost) {
+            FURI_LOG_W(TAG, "Card lost");
+            view_dispatcher_send_custom_event(app->view_dispatcher, EventReadFailed);
+            return NfcCommandStop;
+        }
+    }
+    return NfcCommandContinue;
+}
 
-            uint8_t sector = g_current_read_sector;
-            uint8_t first_block = sector * 4;  // Sector 0 -> block 0, Sector 1 -> block 4
+NfcCommand dump_poller_callback(NfcGenericEvent event, void* context) {
+    App* app = context;
 
-            memcpy(key.data, app->derived_keys.keys[sector], MF_CLASSIC_KEY_SIZE);
-            FURI_LOG_I(TAG, "Reading sector %d (block %d)...", sector, first_block);
+    if(event.protocol == NfcProtocolMfClassic) {
+        const MfClassicPollerEvent* mf_event = event.event_data;
+
+        if(mf_event->type == MfClassicPollerEventTypeRequestMode) {
+            // Let the poller's own read mode walk the sectors: it halts and
+            // re-activates the card between sectors, so one sector failing
+            // auth does not take the rest of the dump down with it
+            MfClassicPollerEventDataRequestMode* mode_data = &mf_event->data->poller_mode;
+            mode_data->mode = MfClassicPollerModeRead;
+            mode_data->data = app->mf_data;
 
-            err = mf_classic_poller_auth(poller, first_block, &key, MfClassicKeyTypeA, &auth_ctx, false);
+            if(!session_load_uid(app, BAMBU_NUM_SECTORS)) {
+                view_dispatcher_send_custom_event(app->view_dispatcher, EventReadFailed);
+                return NfcCommandStop;
+            }
+            app->dump_next_sector = 0;
+            FURI_LOG_I(TAG, "Dump: RequestMode, reading %d sectors", BAMBU_NUM_SECTORS);
+            return NfcCommandContinue;
+        }
 
-            if(err == MfClassicErrorNone) {
-                FURI_LOG_I(TAG, "Sector %d Auth OK", sector);
-
-                if(sector == 0) {
-                    // Read blocks 1 and 2
-                    if(mf_classic_poller_read_block(poller, 1, &block_data) == MfClassicErrorNone) {
-                        memcpy(app->read_data.block1, block_data.data, 16);
-                        FURI_LOG_I(TAG, "Block 1: %02X %02X %02X %02X...",
-                            block_data.data[0], block_data.data[1],
-                            block_data.data[2], block_data.data[3]);
-                    }
-                    if(mf_classic_poller_read_block(poller, 2, &block_data) == MfClassicErrorNone) {
-                        memcpy(app->read_data.block2, block_data.data, 16);
-                        FURI_LOG_I(TAG, "Block 2: %02X %02X %02X %02X...",
-                            block_data.data[0], block_data.data[1],
-                            block_data.data[2], block_data.data[3]);
-                    }
-                } else {
-                    // Read blocks 4, 5, and 6
-                    if(mf_classic_poller_read_block(poller, 4, &block_data) == MfClassicErrorNone) {
-                        memcpy(app->read_data.block4, block_data.data, 16);
-                        FURI_LOG_I(TAG, "Block 4: %02X %02X %02X %02X...",
-                            block_data.data[0], block_data.data[1],
-                            block_data.data[2], block_data.data[3]);
-                    }
-                    if(mf_classic_poller_read_block(poller, 5, &block_data) == MfClassicErrorNone) {
-                        memcpy(app->read_data.block5, block_data.data, 16);
-                        FURI_LOG_I(TAG, "Block 5: %02X %02X %02X %02X...",
-                            block_data.data[0], block_data.data[1],
-                            block_data.data[2], block_data.data[3]);
-                    }
-                    // Read block 6 (manufacturer) - gracefully handle failure
-                    // block6 is already zeroed by memset in scene on_enter
-                    if(mf_classic_poller_read_block(poller, 6, &block_data) == MfClassicErrorNone) {
-                        memcpy(app->read_data.block6, block_data.data, 16);
-                        FURI_LOG_I(TAG, "Block 6: %02X %02X %02X %02X...",
-                            block_data.data[0], block_data.data[1],
-                            block_data.data[2], block_data.data[3]);
-                    } else {
-                        // Block 6 read failed - continue with zeroed data (shows "Generic")
-                        FURI_LOG_I(TAG, "Block 6 read failed - defaulting to Generic");
-                    }
-                }
+        if(mf_event->type == MfClassicPollerEventTypeRequestReadSector) {
+            // Hand out the derived key A for each sector in turn
+            MfClassicPollerEventDataReadSectorRequest* request =
+                &mf_event->data->read_sector_request_data;
+            if(app->dump_next_sector < BAMBU_NUM_SECTORS) {
+                uint8_t sector = app->dump_next_sector++;
+                request->sector_num = sector;
+                memcpy(request->key.data, app->derived_keys.keys[sector], MF_CLASSIC_KEY_SIZE);
+                request->key_type = MfClassicKeyTypeA;
+                request->key_provided = true;
             } else {
-                FURI_LOG_E(TAG, "Sector %d Auth Failed: %d", sector, err);
+                request->key_provided = false;
             }
+            return NfcCommandContinue;
+        }
 
-            // Signal that this pass is done
-            app->read_in_progress = false;
+        if(mf_event->type == MfClassicPollerEventTypeSuccess) {
+            NfcPoller* nfc_poller = nfc_session_get_poller(app->nfc_session);
+            mf_classic_copy(app->mf_data, nfc_poller_get_data(nfc_poller));
+
+            // Record failed sectors, then lift the Bambu blocks out of the image
+            app->read_data.dump_failed_sectors = 0;
+            for(uint8_t sector = 0; sector < BAMBU_NUM_SECTORS; sector++) {
+                if(!mf_classic_is_key_found(app->mf_data, sector, MfClassicKeyTypeA)) {
+                    app->read_data.dump_failed_sectors |= (1 << sector);
+                    FURI_LOG_W(TAG, "Dump: sector %d auth failed", sector);
+                }
+            }
+            memcpy(app->read_data.block1, app->mf_data->block[1].data, 16);
+            memcpy(app->read_data.block2, app->mf_data->block[2].data, 16);
+            memcpy(app->read_data.block4, app->mf_data->block[4].data, 16);
+            memcpy(app->read_data.block5, app->mf_data->block[5].data, 16);
+            memcpy(app->read_data.block6, app->mf_data->block[6].data, 16);
+            app->read_data.has_dump = true;
+
+            // The Bambu data lives in sectors 0 and 1, without them it is not a spool tag
+            app->read_success = (app->read_data.dump_failed_sectors & 0x0003) == 0;
+            FURI_LOG_I(
+                TAG, "Dump complete, failed sectors: %04X", app->read_data.dump_failed_sectors);
+            view_dispatcher_send_custom_event(
+                app->view_dispatcher, app->read_success ? EventReadSuccess : EventReadFailed);
             return NfcCommandStop;
         }
 
-        if(mf_event->type == MfClassicPollerEventTypeCardLost) {
-            FURI_LOG_W(TAG, "Card lost");
-            app->read_in_progress = false;
+        if(mf_event->type == MfClassicPollerEventTypeFail ||
+           mf_event->type == MfClassicPollerEventTypeCardLost) {
+            FURI_LOG_W(TAG, "Dump failed (event %d)", mf_event->type);
+            view_dispatcher_send_custom_event(app->view_dispatcher, EventReadFailed);
             return NfcCommandStop;
         }
     }
@@ -8,21 +8,27 @@
 
 #include "bambu_tagger.h"
 
-// Global variables for multi-pass read/write tracking
-extern uint8_t g_current_read_sector;
-extern uint8_t g_current_write_sector;
-
 // NFC scanner callback
 void scanner_callback(NfcScannerEvent event, void* context);
 
-// UID poller callback (ISO14443-3A)
-NfcCommand uid_poller_callback(NfcGenericEvent event, void* context);
-
-// Tag type detection callback
-NfcCommand detect_tag_type_callback(NfcGenericEvent event, void* context);
-
-// Write poller callback
+// Write poller callback (sectors 0 and 1 in a single session). With
+// App::write_detect set it first loads the UID, derives keys and detects the
+// tag type in the same session, posting EventTagTypeDetected instead of
+// writing for original Bambu tags, missing UIDs and UIDs already in the batch.
 NfcCommand write_poller_callback(NfcGenericEvent event, void* context);
 
-// Read poller callback
+// Read poller callback (UID, keys and sectors 0 and 1 in a single session)
 NfcCommand read_poller_callback(NfcGenericEvent event, void* context);
+
+// Full dump callback (UID, keys and all 16 sectors into App::mf_data)
+NfcCommand dump_poller_callback(NfcGenericEvent event, void* context);
+
+// True if the current tag_data UID was already written in this batch
+bool batch_uid_seen(const App* app);
+
+// Inventory UID set: seen check and insert for the current tag_data UID.
+// inventory_uid_add returns false if the UID was present, and must not be
+// called once inventory_uid_full is true.
+bool inventory_uid_seen(const App* app);
+bool inventory_uid_add(App* app);
+bool inventory_uid_full(const App* app);
@@ -0,0 +1,107 @@
+/**
+ * @file nfc_session.c
+ * @brief NFC session: owns the scanner and poller across scenes
+ * @author Tai Nguyen <taiducnguyen.drexel@gmail.com>
+ */
+
+#include "nfc_session.h"
+#include "nfc_operations.h"
+
+struct NfcSession {
+    App* app;
+    NfcScanner* scanner;  // Allocated once, restarted for every detect
+    NfcPoller* poller;    // Allocated per operation, see nfc_session_start_poller
+    NfcSessionOp op;
+
+    // Time spent tearing down and setting up scanner/poller, logged on free
+    uint32_t churn_ticks;
+    uint32_t op_count;
+};
+
+NfcSession* nfc_session_alloc(App* app) {
+    NfcSession* session = malloc(sizeof(NfcSession));
+    memset(session, 0, sizeof(NfcSession));
+
+    session->app = app;
+    session->scanner = nfc_scanner_alloc(app->nfc);
+    session->op = NfcSessionOpIdle;
+
+    return session;
+}
+
+void nfc_session_free(NfcSession* session) {
+    nfc_session_cancel(session);
+    nfc_scanner_free(session->scanner);
+
+    FURI_LOG_I(
+        TAG,
+        "NFC session: %lu ops, %lu ms setup/teardown",
+        (unsigned long)session->op_count,
+        (unsigned long)(session->churn_ticks * 1000 / furi_kernel_get_tick_frequency()));
+    free(session);
+}
+
+// Stop without timing, callers account for it
+static void nfc_session_stop(NfcSession* session) {
+    if(session->op == NfcSessionOpDetect) {
+        nfc_scanner_stop(session->scanner);
+    } else if(session->poller) {
+        nfc_poller_stop(session->poller);
+        nfc_poller_free(session->poller);
+        session->poller = NULL;
+    }
+    session->op = NfcSessionOpIdle;
+}
+
+void nfc_session_cancel(NfcSession* session) {
+    if(session->op == NfcSessionOpIdle) return;
+
+    uint32_t start = furi_get_tick();
+    nfc_session_stop(session);
+    session->churn_ticks += furi_get_tick() - start;
+}
+
+// The MfClassic poller keeps its card state across nfc_poller_stop(), a
+// restarted instance would skip CardDetected for a card still in the field,
+// so only the scanner is reused and each poller operation gets a new poller
+static void nfc_session_start_poller(NfcSession* session, NfcSessionOp op, NfcGenericCallback callback) {
+    uint32_t start = furi_get_tick();
+    nfc_session_stop(session);
+
+    session->poller = nfc_poller_alloc(session->app->nfc, NfcProtocolMfClassic);
+    session->op = op;
+    nfc_poller_start(session->poller, callback, session->app);
+
+    session->churn_ticks += furi_get_tick() - start;
+    session->op_count++;
+}
+
+void nfc_session_detect(NfcSession* session) {
+    uint32_t start = furi_get_tick();
+    nfc_session_stop(session);
+
+    session->op = NfcSessionOpDetect;
+    nfc_scanner_start(session->scanner, scanner_callback, session->app);
+
+    session->churn_ticks += furi_get_tick() - start;
+    session->op_count++;
+}
+
+void nfc_session_read(NfcSession* session, bool full_dump) {
+    nfc_session_start_poller(
+        session, NfcSessionOpRead, full_dump ? dump_poller_callback : read_poller_callback);
+}
+
+void nfc_session_write(NfcSession* session, bool detect) {
+    // Set before the poller starts, the callback reads it on the NFC thread
+    session->app->write_detect = detect;
+    nfc_session_start_poller(session, NfcSessionOpWrite, write_poller_callback);
+}
+
+NfcSessionOp nfc_session_get_op(const NfcSession* session) {
+    return session->op;
+}
+
+NfcPoller* nfc_session_get_poller(const NfcSession* session) {
+    return session->poller;
+}
@@ -0,0 +1,43 @@
+/**
+ * @file nfc_session.h
+ * @brief NFC session: owns the scanner and poller across scenes
+ * @author Tai Nguyen <taiducnguyen.drexel@gmail.com>
+ */
+
+#pragma once
+
+#include "bambu_tagger.h"
+
+// One operation runs at a time. Starting an operation cancels the one
+// running; completion is reported through the app's custom events.
+typedef enum {
+    NfcSessionOpIdle,
+    NfcSessionOpDetect,  // Scanner armed, posts EventTagDetected
+    NfcSessionOpRead,    // Read plan, posts EventReadSuccess/Failed/Duplicate
+    NfcSessionOpWrite,   // Write plan, posts EventWrite* or EventTagTypeDetected
+} NfcSessionOp;
+
+// Allocate the session for the app's Nfc instance
+NfcSession* nfc_session_alloc(App* app);
+
+// Cancel any running operation and free the session
+void nfc_session_free(NfcSession* session);
+
+// Wait for a card to enter the field
+void nfc_session_detect(NfcSession* session);
+
+// Read sectors 0 and 1, or all 16 sectors with full_dump
+void nfc_session_read(NfcSession* session, bool full_dump);
+
+// Write the current plan; with detect the tag type is checked in the same session
+void nfc_session_write(NfcSession* session, bool detect);
+
+// Stop the running operation, returns once no callback can run anymore
+void nfc_session_cancel(NfcSession* session);
+
+// Operation started last, still reported after its completion event until
+// another operation is started or the session is cancelled
+NfcSessionOp nfc_session_get_op(const NfcSession* session);
+
+// Poller of the running read/write operation, for nfc_poller_get_data()
+NfcPoller* nfc_session_get_poller(const NfcSession* session);
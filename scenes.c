@@ -6,7 +6,10 @@
 
 #include "scenes.h"
 #include "nfc_operations.h"
+#include "nfc_session.h"
+#include "storage_worker.h"
 #include "tag_storage.h"
+#include "tag_manifest.h"
 
 // ============================================
 // Scene handler arrays
@@ -27,6 +30,8 @@ const SceneManagerHandlers scene_handlers = {
             scene_read_tag_result_on_enter,
             scene_saved_tags_on_enter,
             scene_saved_tag_view_on_enter,
+            scene_batch_write_on_enter,
+            scene_inventory_on_enter,
         },
     .on_event_handlers =
         (bool (*const[])(void*, SceneManagerEvent)){
@@ -43,6 +48,8 @@ const SceneManagerHandlers scene_handlers = {
             scene_read_tag_result_on_event,
             scene_saved_tags_on_event,
             scene_saved_tag_view_on_event,
+            scene_batch_write_on_event,
+            scene_inventory_on_event,
         },
     .on_exit_handlers =
         (void (*const[])(void*)){
@@ -59,17 +66,39 @@ const SceneManagerHandlers scene_handlers = {
             scene_read_tag_result_on_exit,
             scene_saved_tags_on_exit,
             scene_saved_tag_view_on_exit,
+            scene_batch_write_on_exit,
+            scene_inventory_on_exit,
         },
     .scene_num = SceneCount,
 };
 
-// Helper to extract null-terminated string from block data
-void extract_string(const uint8_t* data, size_t offset, size_t max_len, char* out) {
-    size_t i;
-    for(i = 0; i < max_len && data[offset + i] != 0; i++) {
-        out[i] = (char)data[offset + i];
+// Helper to format the UID in tag_data as "04:A1:B2:C3:D4:E5:F6", every byte of uid_len
+static void format_uid(const App* app, char* out, size_t size) {
+    size_t pos = 0;
+
+    out[0] = '\0';
+    for(uint8_t i = 0; i < MIN(app->tag_data.uid_len, sizeof(app->tag_data.uid)) && pos < size;
+        i++) {
+        pos += snprintf(&out[pos], size - pos, "%s%02X", i ? ":" : "", app->tag_data.uid[i]);
+    }
+}
+
+// Helper to append "Sectors: 14/16 read" and the failed sector list of a full dump
+static void append_dump_summary(App* app, FuriString* text) {
+    uint8_t failed_count = 0;
+    for(uint8_t sector = 0; sector < BAMBU_NUM_SECTORS; sector++) {
+        if(app->read_data.dump_failed_sectors & (1 << sector)) failed_count++;
+    }
+    furi_string_cat_printf(
+        text, "\nSectors: %d/%d read", BAMBU_NUM_SECTORS - failed_count, BAMBU_NUM_SECTORS);
+    if(failed_count > 0) {
+        furi_string_cat(text, "\nFailed:");
+        for(uint8_t sector = 0; sector < BAMBU_NUM_SECTORS; sector++) {
+            if(app->read_data.dump_failed_sectors & (1 << sector)) {
+                furi_string_cat_printf(text, " %d", sector);
+            }
+        }
     }
-    out[i] = '\0';
 }
 
 // ============================================
@@ -83,6 +112,10 @@ static void main_menu_callback(void* context, uint32_t index) {
         view_dispatcher_send_custom_event(app->view_dispatcher, EventMainMenuProgram);
     } else if(index == 2) {
         view_dispatcher_send_custom_event(app->view_dispatcher, EventMainMenuSaved);
+    } else if(index == 3) {
+        view_dispatcher_send_custom_event(app->view_dispatcher, EventMainMenuDump);
+    } else if(index == 4) {
+        view_dispatcher_send_custom_event(app->view_dispatcher, EventMainMenuInventory);
     }
 }
 
@@ -91,6 +124,8 @@ void scene_main_menu_on_enter(void* context) {
     submenu_reset(app->submenu);
     submenu_set_header(app->submenu, "Bambu Tagger");
     submenu_add_item(app->submenu, "Read Tag", 0, main_menu_callback, app);
+    submenu_add_item(app->submenu, "Dump Full Tag", 3, main_menu_callback, app);
+    submenu_add_item(app->submenu, "Inventory", 4, main_menu_callback, app);
     submenu_add_item(app->submenu, "Program Tag", 1, main_menu_callback, app);
     submenu_add_item(app->submenu, "Saved Tags", 2, main_menu_callback, app);
     view_dispatcher_switch_to_view(app->view_dispatcher, ViewSubmenu);
@@ -103,8 +138,17 @@ bool scene_main_menu_on_event(void* context, SceneManagerEvent event) {
     if(event.type == SceneManagerEventTypeCustom) {
         if(event.event == EventMainMenuRead) {
             // Start reading
+            app->full_dump = false;
+            scene_manager_next_scene(app->scene_manager, SceneReadTagScan);
+            consumed = true;
+        } else if(event.event == EventMainMenuDump) {
+            // Start reading all 16 sectors
+            app->full_dump = true;
             scene_manager_next_scene(app->scene_manager, SceneReadTagScan);
             consumed = true;
+        } else if(event.event == EventMainMenuInventory) {
+            scene_manager_next_scene(app->scene_manager, SceneInventory);
+            consumed = true;
         } else if(event.event == EventMainMenuProgram) {
             // Initialize defaults
             app->tag_data.filament_index = 0;
@@ -115,7 +159,8 @@ bool scene_main_menu_on_event(void* context, SceneManagerEvent event) {
             scene_manager_next_scene(app->scene_manager, SceneSelectFilament);
             consumed = true;
         } else if(event.event == EventMainMenuSaved) {
-            // Show saved tags
+            // Show saved tags, from the top
+            app->saved_cursor_set = false;
             scene_manager_next_scene(app->scene_manager, SceneSavedTags);
             consumed = true;
         }
@@ -322,6 +367,8 @@ static void confirm_button_callback(GuiButtonType result, InputType type, void*
     App* app = context;
     if(type == InputTypeShort && result == GuiButtonTypeRight) {
         view_dispatcher_send_custom_event(app->view_dispatcher, EventConfirmed);
+    } else if(type == InputTypeShort && result == GuiButtonTypeLeft) {
+        view_dispatcher_send_custom_event(app->view_dispatcher, EventBatchStart);
     }
 }
 
@@ -354,6 +401,8 @@ void scene_confirm_on_enter(void* context) {
     // Add scan button
     widget_add_button_element(
         app->widget, GuiButtonTypeRight, "Scan", confirm_button_callback, app);
+    widget_add_button_element(
+        app->widget, GuiButtonTypeLeft, "Batch", confirm_button_callback, app);
 
     view_dispatcher_switch_to_view(app->view_dispatcher, ViewWidget);
 }
@@ -369,6 +418,10 @@ bool scene_confirm_on_event(void* context, SceneManagerEvent event) {
             app->write_to_blank = true;  // Use default key for blank tags
             scene_manager_next_scene(app->scene_manager, SceneScanTag);
             consumed = true;
+        } else if(event.event == EventBatchStart) {
+            app->use_saved_tag = false;
+            scene_manager_next_scene(app->scene_manager, SceneBatchWrite);
+            consumed = true;
         }
     } else if(event.type == SceneManagerEventTypeBack) {
         // Allow back navigation
@@ -389,128 +442,30 @@ void scene_scan_tag_on_enter(void* context) {
     App* app = context;
 
     // Reset all state
-    app->card_detected = false;
-    app->uid_read = false;
-    app->detection_in_progress = false;
     app->detected_tag_type = TagTypeUnknown;
-    app->scanner = NULL;
-    app->poller = NULL;
 
     widget_reset(app->widget);
     widget_add_text_scroll_element(
         app->widget, 0, 0, 128, 64, "Place tag on\nFlipper's back\n\nScanning...");
     view_dispatcher_switch_to_view(app->view_dispatcher, ViewWidget);
 
-    // Start scanner
-    app->scanner = nfc_scanner_alloc(app->nfc);
-    nfc_scanner_start(app->scanner, scanner_callback, app);
+    nfc_session_detect(app->nfc_session);
 }
 
 bool scene_scan_tag_on_event(void* context, SceneManagerEvent event) {
     App* app = context;
     bool consumed = false;
 
-    if(event.type == SceneManagerEventTypeTick) {
-        // Check if card detected and we haven't started UID read yet
-        if(app->card_detected && !app->uid_read && app->poller == NULL) {
-            // Stop scanner and start UID read
-            if(app->scanner) {
-                nfc_scanner_stop(app->scanner);
-                nfc_scanner_free(app->scanner);
-                app->scanner = NULL;
-            }
-
-            widget_reset(app->widget);
-            widget_add_text_scroll_element(app->widget, 0, 0, 128, 64, "Reading UID...");
-
-            // Start ISO14443-3A poller to read UID
-            app->poller = nfc_poller_alloc(app->nfc, NfcProtocolIso14443_3a);
-            nfc_poller_start(app->poller, uid_poller_callback, app);
-        }
-
-        if(app->uid_read && !app->detection_in_progress && app->detected_tag_type == TagTypeUnknown) {
-            // UID read successful, start tag type detection
-            if(app->poller) {
-                nfc_poller_stop(app->poller);
-                nfc_poller_free(app->poller);
-                app->poller = NULL;
-            }
-
-            // Calculate keys from UID
-            calculate_all_keys(app->tag_data.uid, app->tag_data.uid_len, &app->derived_keys);
-
-            FURI_LOG_I(
-                TAG,
-                "UID: %02X %02X %02X %02X",
-                app->tag_data.uid[0],
-                app->tag_data.uid[1],
-                app->tag_data.uid[2],
-                app->tag_data.uid[3]);
-            FURI_LOG_I(
-                TAG,
-                "Key[0]: %02X %02X %02X %02X %02X %02X",
-                app->derived_keys.keys[0][0],
-                app->derived_keys.keys[0][1],
-                app->derived_keys.keys[0][2],
-                app->derived_keys.keys[0][3],
-                app->derived_keys.keys[0][4],
-                app->derived_keys.keys[0][5]);
-
-            // Start tag type detection
-            widget_reset(app->widget);
-            widget_add_text_scroll_element(app->widget, 0, 0, 128, 64, "Detecting tag type...");
-
-            app->detection_in_progress = true;
-            app->poller = nfc_poller_alloc(app->nfc, NfcProtocolMfClassic);
-            nfc_poller_start(app->poller, detect_tag_type_callback, app);
-        }
-
-        // Check detection result
-        if(app->uid_read && !app->detection_in_progress && app->detected_tag_type != TagTypeUnknown) {
-            if(app->poller) {
-                nfc_poller_stop(app->poller);
-                nfc_poller_free(app->poller);
-                app->poller = NULL;
-            }
-
-            if(app->detected_tag_type == TagTypeBambu) {
-                // Show error - cannot reprogram Bambu tags
-                app->detected_tag_type = TagTypeUnknown;  // Prevent retriggering
-                app->detection_in_progress = true;  // Block re-entry
-                widget_reset(app->widget);
-                widget_add_text_scroll_element(
-                    app->widget,
-                    0,
-                    0,
-                    128,
-                    64,
-                    "Bambu Tag Detected!\n\n"
-                    "This tag has read-only\n"
-                    "access bits and cannot\n"
-                    "be reprogrammed.\n\n"
-                    "Use a blank MIFARE\n"
-                    "Classic 1K tag.");
-                notification_message(app->notifications, &sequence_error);
-                consumed = true;
-            } else {
-                // Blank tag - proceed to write
-                scene_manager_next_scene(app->scene_manager, SceneWriteTag);
-                consumed = true;
-            }
-        }
-    } else if(event.type == SceneManagerEventTypeBack) {
-        // Clean up scanner if running
-        if(app->scanner) {
-            nfc_scanner_stop(app->scanner);
-            nfc_scanner_free(app->scanner);
-            app->scanner = NULL;
-        }
-        if(app->poller) {
-            nfc_poller_stop(app->poller);
-            nfc_poller_free(app->poller);
-            app->poller = NULL;
+    if(event.type == SceneManagerEventTypeCustom) {
+        if(event.event == EventTagDetected &&
+           nfc_session_get_op(app->nfc_session) == NfcSessionOpDetect) {
+            // Card detected: the write session detects the tag type and writes
+            // in one activation, original Bambu tags are rejected there
+            nfc_session_cancel(app->nfc_session);
+            app->write_detect = true;
+            scene_manager_next_scene(app->scene_manager, SceneWriteTag);
+            consumed = true;
         }
-        consumed = false;
     }
     return consumed;
 }
@@ -518,81 +473,156 @@ bool scene_scan_tag_on_event(void* context, SceneManagerEvent event) {
 void scene_scan_tag_on_exit(void* context) {
     App* app = context;
     widget_reset(app->widget);
+    nfc_session_cancel(app->nfc_session);
+}
 
-    // Clean up scanner if still running
-    if(app->scanner) {
-        nfc_scanner_stop(app->scanner);
-        nfc_scanner_free(app->scanner);
-        app->scanner = NULL;
+// ============================================
+// Scene: Write Tag
+// ============================================
+// Short label for a block's write status
+static const char* write_status_label(WriteBlockStatus status) {
+    switch(status) {
+    case WriteBlockStatusSkipped:
+        return "=";
+    case WriteBlockStatusWritten:
+        return "W";
+    case WriteBlockStatusVerified:
+        return "OK";
+    case WriteBlockStatusMismatch:
+        return "BAD";
+    case WriteBlockStatusFailed:
+        return "FAIL";
+    default:
+        return "--";
     }
+}
 
-    // Clean up poller if still running
-    if(app->poller) {
-        nfc_poller_stop(app->poller);
-        nfc_poller_free(app->poller);
-        app->poller = NULL;
+// Format per-block write status, e.g. "B1:OK B2:= B3:BAD"
+// (OK = written and verified, = = already matched, W = written, not verified)
+static void format_write_status(App* app, FuriString* out) {
+    furi_string_reset(out);
+    for(uint8_t block = 1; block < 8; block++) {
+        furi_string_cat_printf(
+            out,
+            "B%d:%s%s",
+            block,
+            write_status_label(app->write_status[block]),
+            (block % 4 == 3) ? "\n" : " ");
+    }
+
+    // Cloned dump sectors 2-15 (blocks 8-63) only get a count
+    uint8_t ok = 0;
+    uint8_t bad = 0;
+    for(uint8_t block = 8; block < WRITE_BLOCK_COUNT; block++) {
+        WriteBlockStatus status = app->write_status[block];
+        if(status == WriteBlockStatusVerified || status == WriteBlockStatusSkipped) ok++;
+        if(status == WriteBlockStatusMismatch || status == WriteBlockStatusFailed) bad++;
+    }
+    if(ok > 0 || bad > 0) {
+        furi_string_cat_printf(out, "Blocks 8-63: %d ok, %d bad", ok, bad);
     }
 }
 
-// ============================================
-// Scene: Write Tag
-// ============================================
+// Summarize a successful write, e.g. "3 written, 4 unchanged"
+static void format_write_summary(App* app, FuriString* out) {
+    uint8_t written = 0;
+    uint8_t skipped = 0;
+    for(uint8_t block = 1; block < WRITE_BLOCK_COUNT; block++) {
+        if(app->write_status[block] == WriteBlockStatusVerified) written++;
+        if(app->write_status[block] == WriteBlockStatusSkipped) skipped++;
+    }
+    furi_string_printf(out, "%d written, %d unchanged", written, skipped);
+}
+
 void scene_write_tag_on_enter(void* context) {
     App* app = context;
 
     // Reset state
     app->write_success = false;
     app->write_in_progress = true;
-    app->poller = NULL;
-    g_current_write_sector = 0;  // Start with sector 0
+    scene_manager_set_scene_state(app->scene_manager, SceneWriteTag, 0);
+    for(size_t i = 0; i < WRITE_BLOCK_COUNT; i++) {
+        app->write_status[i] = WriteBlockStatusPending;
+    }
 
     widget_reset(app->widget);
     widget_add_text_scroll_element(
-        app->widget, 0, 0, 128, 64, "Writing sector 0...\n\nKeep tag on\nFlipper's back");
+        app->widget, 0, 0, 128, 64, "Writing tag...\n\nKeep tag on\nFlipper's back");
     view_dispatcher_switch_to_view(app->view_dispatcher, ViewWidget);
 
-    // Start Mifare Classic poller for writing sector 0
-    app->poller = nfc_poller_alloc(app->nfc, NfcProtocolMfClassic);
-    nfc_poller_start(app->poller, write_poller_callback, app);
+    // Detection and sectors 0 and 1 in one session
+    nfc_session_write(app->nfc_session, app->write_detect);
 }
 
 bool scene_write_tag_on_event(void* context, SceneManagerEvent event) {
     App* app = context;
     bool consumed = false;
 
-    if(event.type == SceneManagerEventTypeTick) {
-        // Handle poller completion
-        if(!app->write_in_progress && app->poller != NULL) {
-            nfc_poller_stop(app->poller);
-            nfc_poller_free(app->poller);
-            app->poller = NULL;
-            FURI_LOG_I(TAG, "Write poller stopped, sector %d done", g_current_write_sector);
-        }
+    if(event.type == SceneManagerEventTypeCustom) {
+        if((event.event == EventWriteSuccess || event.event == EventWriteFailed) &&
+           app->write_in_progress) {
+            app->write_in_progress = false;
+            nfc_session_cancel(app->nfc_session);
+
+            FuriString* status = furi_string_alloc();
+            format_write_status(app, status);
+            FURI_LOG_I(TAG, "Write poller stopped: %s", furi_string_get_cstr(status));
+            furi_string_free(status);
 
-        // Check if we need another pass
-        if(!app->write_in_progress && app->poller == NULL) {
-            if(g_current_write_sector == 0) {
-                // Sector 0 done, now do sector 1
-                g_current_write_sector = 1;
+            scene_manager_next_scene(app->scene_manager, SceneResult);
+            consumed = true;
+        } else if(event.event == EventTagTypeDetected && app->write_in_progress) {
+            nfc_session_cancel(app->nfc_session);
+
+            if(app->detected_tag_type == TagTypeBambu) {
+                // Show error - cannot reprogram Bambu tags, nothing was written
+                app->write_in_progress = false;
+                scene_manager_set_scene_state(app->scene_manager, SceneWriteTag, 1);
                 widget_reset(app->widget);
                 widget_add_text_scroll_element(
-                    app->widget, 0, 0, 128, 64, "Writing sector 1...\n\nKeep tag on\nFlipper's back");
-
-                FURI_LOG_I(TAG, "Starting sector 1 write pass");
-                app->write_in_progress = true;
-                app->poller = nfc_poller_alloc(app->nfc, NfcProtocolMfClassic);
-                nfc_poller_start(app->poller, write_poller_callback, app);
+                    app->widget,
+                    0,
+                    0,
+                    128,
+                    64,
+                    "Bambu Tag Detected!\n\n"
+                    "This tag has read-only\n"
+                    "access bits and cannot\n"
+                    "be reprogrammed.\n\n"
+                    "Use a blank MIFARE\n"
+                    "Classic 1K tag.");
+                notification_message(app->notifications, &sequence_error);
             } else {
-                // Both sectors written
-                app->write_success = true;
-                FURI_LOG_I(TAG, "Both sectors written successfully!");
-                scene_manager_next_scene(app->scene_manager, SceneResult);
-                consumed = true;
+                // No UID from the session - wait for the tag again
+                nfc_session_write(app->nfc_session, true);
             }
+            consumed = true;
+        } else if(
+            (event.event == EventWriteInterrupted || event.event == EventWriteWrongTag) &&
+            app->write_in_progress) {
+            // The write journal keeps what reached the card, wait for the same
+            // tag and carry on from the first unfinished block
+            scene_manager_set_scene_state(app->scene_manager, SceneWriteTag, 1);
+
+            widget_reset(app->widget);
+            widget_add_text_scroll_element(
+                app->widget,
+                0,
+                0,
+                128,
+                64,
+                event.event == EventWriteWrongTag ?
+                    "Different tag!\n\nPlace the tag that\nwas being written" :
+                    "Tag lost!\n\nPlace the same tag\nback to resume");
+            notification_message(app->notifications, &sequence_error);
+
+            nfc_session_write(app->nfc_session, false);
+            consumed = true;
         }
     } else if(event.type == SceneManagerEventTypeBack) {
-        // Don't allow back during write
-        consumed = true;
+        // Don't allow back during write, only while waiting to resume.
+        // The journal stays in RAM, so the same tag resumes on the next write.
+        consumed = scene_manager_get_scene_state(app->scene_manager, SceneWriteTag) == 0;
     }
     return consumed;
 }
@@ -600,12 +630,7 @@ bool scene_write_tag_on_event(void* context, SceneManagerEvent event) {
 void scene_write_tag_on_exit(void* context) {
     App* app = context;
     widget_reset(app->widget);
-
-    if(app->poller) {
-        nfc_poller_stop(app->poller);
-        nfc_poller_free(app->poller);
-        app->poller = NULL;
-    }
+    nfc_session_cancel(app->nfc_session);
 }
 
 // ============================================
@@ -618,17 +643,21 @@ void scene_result_on_enter(void* context) {
 
     if(app->write_success) {
         popup_set_header(app->popup, "Success!", 64, 20, AlignCenter, AlignBottom);
-        popup_set_text(app->popup, "Tag programmed\nsuccessfully!", 64, 40, AlignCenter, AlignBottom);
+        // Blocks that already matched were not rewritten
+        format_write_summary(app, app->result_text);
+        furi_string_cat_str(app->result_text, "\nall verified");
+        if(app->nfc_retries > 0) {
+            furi_string_cat_printf(app->result_text, ", %d retries", app->nfc_retries);
+        }
+        popup_set_text(
+            app->popup, furi_string_get_cstr(app->result_text), 64, 44, AlignCenter, AlignBottom);
         notification_message(app->notifications, &sequence_success);
     } else {
-        popup_set_header(app->popup, "Write Failed", 64, 20, AlignCenter, AlignBottom);
+        // Show which blocks made it to the card
+        format_write_status(app, app->result_text);
+        popup_set_header(app->popup, "Write Failed", 64, 2, AlignCenter, AlignTop);
         popup_set_text(
-            app->popup,
-            "Auth error or\nnot Mifare Classic",
-            64,
-            40,
-            AlignCenter,
-            AlignBottom);
+            app->popup, furi_string_get_cstr(app->result_text), 64, 16, AlignCenter, AlignTop);
         notification_message(app->notifications, &sequence_error);
     }
 
@@ -663,133 +692,55 @@ void scene_read_tag_scan_on_enter(void* context) {
     App* app = context;
 
     // Reset all state
-    app->card_detected = false;
-    app->uid_read = false;
     app->read_success = false;
     app->read_in_progress = false;
-    app->scanner = NULL;
-    app->poller = NULL;
-    memset(&app->read_data, 0, sizeof(ReadTagData));  // Clear all read data for multi-pass
-    g_current_read_sector = 0;  // Start with sector 0
+    memset(&app->read_data, 0, sizeof(ReadTagData));  // Clear all read data
 
     widget_reset(app->widget);
     widget_add_text_scroll_element(
         app->widget, 0, 0, 128, 64, "Place tag on\nFlipper's back\n\nScanning...");
     view_dispatcher_switch_to_view(app->view_dispatcher, ViewWidget);
 
-    // Start scanner
-    app->scanner = nfc_scanner_alloc(app->nfc);
-    nfc_scanner_start(app->scanner, scanner_callback, app);
+    nfc_session_detect(app->nfc_session);
 }
 
 bool scene_read_tag_scan_on_event(void* context, SceneManagerEvent event) {
     App* app = context;
     bool consumed = false;
 
-    if(event.type == SceneManagerEventTypeTick) {
-        // Debug: log state
-        FURI_LOG_D(
-            TAG,
-            "Tick: detected=%d uid_read=%d in_progress=%d",
-            app->card_detected,
-            app->uid_read,
-            app->read_in_progress);
-
-        // Check if card detected and we haven't started UID read yet
-        // Also check that poller is NULL to prevent starting multiple pollers
-        if(app->card_detected && !app->uid_read && !app->read_in_progress && app->poller == NULL) {
-            FURI_LOG_I(TAG, "Card detected, starting UID read");
-            // Stop scanner and start UID read
-            if(app->scanner) {
-                nfc_scanner_stop(app->scanner);
-                nfc_scanner_free(app->scanner);
-                app->scanner = NULL;
-            }
-
+    if(event.type == SceneManagerEventTypeCustom) {
+        if(event.event == EventTagDetected &&
+           nfc_session_get_op(app->nfc_session) == NfcSessionOpDetect) {
+            // Card detected: start a read session (UID, keys, sectors 0 and 1 or all 16)
+            FURI_LOG_I(TAG, "Starting read pass, full_dump=%d", app->full_dump);
             widget_reset(app->widget);
-            widget_add_text_scroll_element(app->widget, 0, 0, 128, 64, "Reading UID...");
-
-            // Start ISO14443-3A poller to read UID
-            app->poller = nfc_poller_alloc(app->nfc, NfcProtocolIso14443_3a);
-            nfc_poller_start(app->poller, uid_poller_callback, app);
-        }
+            widget_add_text_scroll_element(
+                app->widget, 0, 0, 128, 64, "Reading tag...\n\nKeep tag on\nFlipper's back");
 
-        if(app->uid_read && !app->read_in_progress && app->poller == NULL) {
-            // Check what data we have
-            bool has_sector0 = (app->read_data.block1[0] != 0 || app->read_data.block2[0] != 0);
-            bool has_sector1 = (app->read_data.block4[0] != 0 || app->read_data.block5[0] != 0);
-
-            // First time after UID read - calculate keys
-            if(!has_sector0 && !has_sector1 && !app->read_success) {
-                calculate_all_keys(app->tag_data.uid, app->tag_data.uid_len, &app->derived_keys);
-                FURI_LOG_I(TAG, "Keys calculated for UID: %02X%02X%02X%02X",
-                    app->tag_data.uid[0], app->tag_data.uid[1],
-                    app->tag_data.uid[2], app->tag_data.uid[3]);
-            }
-
-            if(!has_sector0) {
-                // Pass 1: Read sector 0
-                g_current_read_sector = 0;
-                widget_reset(app->widget);
-                widget_add_text_scroll_element(
-                    app->widget, 0, 0, 128, 64, "Reading sector 0...\n\nKeep tag on\nFlipper's back");
-
-                FURI_LOG_I(TAG, "Starting Pass 1: Sector 0");
-                app->read_in_progress = true;
-                app->poller = nfc_poller_alloc(app->nfc, NfcProtocolMfClassic);
-                nfc_poller_start(app->poller, read_poller_callback, app);
-            } else if(!has_sector1) {
-                // Pass 2: Read sector 1
-                g_current_read_sector = 1;
-                widget_reset(app->widget);
-                widget_add_text_scroll_element(
-                    app->widget, 0, 0, 128, 64, "Reading sector 1...\n\nKeep tag on\nFlipper's back");
-
-                FURI_LOG_I(TAG, "Starting Pass 2: Sector 1");
-                app->read_in_progress = true;
-                app->poller = nfc_poller_alloc(app->nfc, NfcProtocolMfClassic);
-                nfc_poller_start(app->poller, read_poller_callback, app);
-            } else {
-                // Both sectors read, done!
-                app->read_data.valid = true;
-                app->read_success = true;
-                FURI_LOG_I(TAG, "Both sectors read successfully!");
-                scene_manager_next_scene(app->scene_manager, SceneReadTagResult);
-                consumed = true;
-            }
-        }
-
-        // Handle poller completion
-        if(!app->read_in_progress && app->poller != NULL) {
-            nfc_poller_stop(app->poller);
-            nfc_poller_free(app->poller);
-            app->poller = NULL;
-            FURI_LOG_I(TAG, "Poller stopped, checking progress...");
-            // Next tick will check if we need another pass
-        }
-
-        // If we have at least sector 0 and failed to get sector 1, still show results
-        if(!app->read_in_progress && app->poller == NULL) {
-            bool has_sector0 = (app->read_data.block1[0] != 0 || app->read_data.block2[0] != 0);
-            if(has_sector0 && app->read_success) {
+            app->read_in_progress = true;
+            nfc_session_read(app->nfc_session, app->full_dump);
+            consumed = true;
+        } else if(
+            (event.event == EventReadSuccess || event.event == EventReadFailed) &&
+            app->read_in_progress) {
+            app->read_in_progress = false;
+
+            if(event.event == EventReadSuccess) {
+                // UID, keys and the sectors read in one session, done!
+                nfc_session_cancel(app->nfc_session);
                 app->read_data.valid = true;
+                FURI_LOG_I(TAG, "Tag read successfully!");
                 scene_manager_next_scene(app->scene_manager, SceneReadTagResult);
-                consumed = true;
+            } else {
+                // Wait for the tag again and retry
+                FURI_LOG_I(TAG, "Read pass failed, scanning again");
+                widget_reset(app->widget);
+                widget_add_text_scroll_element(
+                    app->widget, 0, 0, 128, 64, "Place tag on\nFlipper's back\n\nScanning...");
+                nfc_session_detect(app->nfc_session);
             }
+            consumed = true;
         }
-    } else if(event.type == SceneManagerEventTypeBack) {
-        // Clean up
-        if(app->scanner) {
-            nfc_scanner_stop(app->scanner);
-            nfc_scanner_free(app->scanner);
-            app->scanner = NULL;
-        }
-        if(app->poller) {
-            nfc_poller_stop(app->poller);
-            nfc_poller_free(app->poller);
-            app->poller = NULL;
-        }
-        consumed = false;
     }
     return consumed;
 }
@@ -797,17 +748,7 @@ bool scene_read_tag_scan_on_event(void* context, SceneManagerEvent event) {
 void scene_read_tag_scan_on_exit(void* context) {
     App* app = context;
     widget_reset(app->widget);
-
-    if(app->scanner) {
-        nfc_scanner_stop(app->scanner);
-        nfc_scanner_free(app->scanner);
-        app->scanner = NULL;
-    }
-    if(app->poller) {
-        nfc_poller_stop(app->poller);
-        nfc_poller_free(app->poller);
-        app->poller = NULL;
-    }
+    nfc_session_cancel(app->nfc_session);
 }
 
 // ============================================
@@ -869,14 +810,7 @@ void scene_read_tag_result_on_enter(void* context) {
 
         // Format UID
         char uid_str[32];
-        snprintf(
-            uid_str,
-            sizeof(uid_str),
-            "%02X:%02X:%02X:%02X",
-            app->tag_data.uid[0],
-            app->tag_data.uid[1],
-            app->tag_data.uid[2],
-            app->tag_data.uid[3]);
+        format_uid(app, uid_str, sizeof(uid_str));
 
         furi_string_printf(
             text,
@@ -894,6 +828,9 @@ void scene_read_tag_result_on_enter(void* context) {
             manufacturer,
             r, g, b,
             weight);
+        if(app->read_data.has_dump) {
+            append_dump_summary(app, text);
+        }
 
         notification_message(app->notifications, &sequence_success);
     } else {
@@ -928,18 +865,20 @@ bool scene_read_tag_result_on_event(void* context, SceneManagerEvent event) {
 
     if(event.type == SceneManagerEventTypeCustom) {
         if(event.event == EventSaveTag) {
-            if(save_tag_to_file(app)) {
-                notification_message(app->notifications, &sequence_success);
-                // Show saved message briefly then go back
-                popup_reset(app->popup);
-                popup_set_header(app->popup, "Saved!", 64, 20, AlignCenter, AlignBottom);
-                popup_set_text(app->popup, "Tag saved to SD card", 64, 40, AlignCenter, AlignBottom);
-                popup_set_timeout(app->popup, 1500);
-                popup_enable_timeout(app->popup);
-                view_dispatcher_switch_to_view(app->view_dispatcher, ViewPopup);
-            } else {
-                notification_message(app->notifications, &sequence_error);
-            }
+            storage_worker_save(app->storage_worker, app);
+            consumed = true;
+        } else if(event.event == EventTagSaved) {
+            notification_message(app->notifications, &sequence_success);
+            // Show saved message briefly then go back
+            popup_reset(app->popup);
+            popup_set_header(app->popup, "Saved!", 64, 20, AlignCenter, AlignBottom);
+            popup_set_text(app->popup, "Tag saved to SD card", 64, 40, AlignCenter, AlignBottom);
+            popup_set_timeout(app->popup, 1500);
+            popup_enable_timeout(app->popup);
+            view_dispatcher_switch_to_view(app->view_dispatcher, ViewPopup);
+            consumed = true;
+        } else if(event.event == EventTagSaveFailed) {
+            notification_message(app->notifications, &sequence_error);
             consumed = true;
         } else if(event.event == EventBack) {
             scene_manager_search_and_switch_to_previous_scene(app->scene_manager, SceneMainMenu);
@@ -961,45 +900,162 @@ void scene_read_tag_result_on_exit(void* context) {
 // ============================================
 // Scene: Saved Tags List
 // ============================================
+// Submenu indexes of the items after the tags
+#define SAVED_TAGS_PREVIOUS_INDEX TAG_MANIFEST_PAGE_SIZE
+#define SAVED_TAGS_NEXT_INDEX (TAG_MANIFEST_PAGE_SIZE + 1)
+#define SAVED_TAGS_SORT_INDEX (TAG_MANIFEST_PAGE_SIZE + 2)
+#define SAVED_TAGS_MIGRATE_INDEX (TAG_MANIFEST_PAGE_SIZE + 3)
+
+// Scene state: what the page being fetched is for
+typedef enum {
+    SavedTagsFetchPage,
+    SavedTagsFetchPrevious,  // Select the last tag
+    SavedTagsFetchSort,      // Keep the sort item selected
+    SavedTagsFetchMigrated,  // Show how many files were converted
+} SavedTagsFetch;
+
+static const char* const SAVED_TAGS_SORT_NAMES[SavedTagsSortCount] = {
+    [SavedTagsSortNone] = "None",
+    [SavedTagsSortName] = "UID",
+    [SavedTagsSortType] = "Type",
+    [SavedTagsSortColor] = "Color",
+    [SavedTagsSortWeight] = "Weight",
+};
+
 static void saved_tags_callback(void* context, uint32_t index) {
     App* app = context;
-    if(index < app->saved_tags_count) {
+    if(index == SAVED_TAGS_MIGRATE_INDEX) {
+        view_dispatcher_send_custom_event(app->view_dispatcher, EventMigrateTags);
+    } else if(index == SAVED_TAGS_SORT_INDEX) {
+        view_dispatcher_send_custom_event(app->view_dispatcher, EventSortTags);
+    } else if(index == SAVED_TAGS_PREVIOUS_INDEX) {
+        view_dispatcher_send_custom_event(app->view_dispatcher, EventSavedTagsPrevious);
+    } else if(index == SAVED_TAGS_NEXT_INDEX) {
+        view_dispatcher_send_custom_event(app->view_dispatcher, EventSavedTagsNext);
+    } else if(index < app->saved_page->count) {
         // Store selected tag path
         furi_string_printf(
             app->saved_tag_path,
             "%s/%s",
             BAMBU_TAGGER_FOLDER,
-            app->saved_tags[index]);
+            app->saved_page->items[index].entry.name);
         view_dispatcher_send_custom_event(app->view_dispatcher, EventSavedTagSelected);
     }
 }
 
-void scene_saved_tags_on_enter(void* context) {
-    App* app = context;
-    submenu_reset(app->submenu);
-    submenu_set_header(app->submenu, "Saved Tags");
+// "PLA Matte, Black, 1kg" from the manifest entry, the name if the tag did not load
+static void saved_tag_label(const TagManifestEntry* entry, char* label, size_t size) {
+    if(entry->type[0] == '\0') {
+        snprintf(label, size, "%s", entry->name);
+        char* ext = strstr(label, BAMBU_TAGGER_EXTENSION);
+        if(ext) *ext = '\0';
+        return;
+    }
+
+    const char* color =
+        COLOR_PRESETS[color_preset_nearest(entry->rgba[0], entry->rgba[1], entry->rgba[2])].name;
+    if(entry->weight % 1000 == 0 && entry->weight > 0) {
+        snprintf(label, size, "%s, %s, %ukg", entry->type, color, entry->weight / 1000);
+    } else {
+        snprintf(label, size, "%s, %s, %ug", entry->type, color, entry->weight);
+    }
+}
 
-    // Load list of saved tags
-    load_saved_tags_list(app);
+// Ask the storage worker for the page starting at saved_cursor (the first
+// page if it is not set) or the page before it, EventSavedTagsPageLoaded
+// brings it back
+static void saved_tags_fetch_page(App* app, SavedTagsFetch fetch) {
+    const TagManifestCursor* start = app->saved_cursor_set ? &app->saved_cursor : NULL;
+
+    scene_manager_set_scene_state(app->scene_manager, SceneSavedTags, fetch);
+    storage_worker_page(
+        app->storage_worker, app->saved_tags_sort, start, fetch == SavedTagsFetchPrevious);
+}
+
+static void saved_tags_fill_menu(App* app) {
+    TagManifestPage* page = app->saved_page;
+
+    submenu_reset(app->submenu);
+    if(page->total > TAG_MANIFEST_PAGE_SIZE) {
+        char header[32];
+        snprintf(
+            header,
+            sizeof(header),
+            "Tags %u-%u of %u",
+            page->first + 1,
+            page->first + page->count,
+            page->total);
+        submenu_set_header(app->submenu, header);
+    } else {
+        submenu_set_header(app->submenu, "Saved Tags");
+    }
 
-    if(app->saved_tags_count == 0) {
+    if(page->count == 0) {
         submenu_add_item(app->submenu, "(No saved tags)", 0, NULL, app);
     } else {
-        for(uint8_t i = 0; i < app->saved_tags_count; i++) {
-            // Remove extension for display
-            char display_name[64];
-            strncpy(display_name, app->saved_tags[i], 63);
-            display_name[63] = '\0';
-            char* ext = strstr(display_name, BAMBU_TAGGER_EXTENSION);
-            if(ext) *ext = '\0';
-
-            submenu_add_item(app->submenu, display_name, i, saved_tags_callback, app);
+        for(uint8_t i = 0; i < page->count; i++) {
+            char label[64];
+            saved_tag_label(&page->items[i].entry, label, sizeof(label));
+            submenu_add_item(app->submenu, label, i, saved_tags_callback, app);
         }
+
+        if(page->first > 0) {
+            submenu_add_item(
+                app->submenu, "[< Previous]", SAVED_TAGS_PREVIOUS_INDEX, saved_tags_callback, app);
+        }
+        if(page->has_next) {
+            submenu_add_item(
+                app->submenu, "[Next >]", SAVED_TAGS_NEXT_INDEX, saved_tags_callback, app);
+        }
+
+        char sort_label[24];
+        snprintf(
+            sort_label, sizeof(sort_label), "[Sort: %s]", SAVED_TAGS_SORT_NAMES[app->saved_tags_sort]);
+        submenu_add_item(app->submenu, sort_label, SAVED_TAGS_SORT_INDEX, saved_tags_callback, app);
     }
+    // Shown with an empty list too, files from before BAMBU_TAG_DB are not listed
+    submenu_add_item(
+        app->submenu, "[Convert old files]", SAVED_TAGS_MIGRATE_INDEX, saved_tags_callback, app);
+}
+
+void scene_saved_tags_on_enter(void* context) {
+    App* app = context;
 
+    // Only the visible page is held, whatever the number of saved tags
+    app->saved_page = malloc(sizeof(TagManifestPage));
+    memset(app->saved_page, 0, sizeof(TagManifestPage));
+    submenu_reset(app->submenu);
+    submenu_set_header(app->submenu, "Saved Tags");
+    submenu_add_item(app->submenu, "(Loading...)", 0, NULL, app);
+    saved_tags_fetch_page(app, SavedTagsFetchPage);
     view_dispatcher_switch_to_view(app->view_dispatcher, ViewSubmenu);
 }
 
+static void saved_tags_show_page(App* app) {
+    TagManifestPage* page = app->saved_page;
+    SavedTagsFetch fetch = scene_manager_get_scene_state(app->scene_manager, SceneSavedTags);
+
+    if(!storage_worker_take_page(app->storage_worker, page)) return;
+    app->saved_cursor_set = page->count > 0;
+    if(app->saved_cursor_set) app->saved_cursor = page->items[0];
+
+    saved_tags_fill_menu(app);
+    if(fetch == SavedTagsFetchPrevious && page->count > 0) {
+        submenu_set_selected_item(app->submenu, page->count - 1);
+    } else if(fetch == SavedTagsFetchSort) {
+        submenu_set_selected_item(app->submenu, SAVED_TAGS_SORT_INDEX);
+    } else if(fetch == SavedTagsFetchMigrated) {
+        char header[32];
+        snprintf(
+            header,
+            sizeof(header),
+            "Converted %u files",
+            storage_worker_get_migrated(app->storage_worker));
+        submenu_set_header(app->submenu, header);
+        notification_message(app->notifications, &sequence_success);
+    }
+}
+
 bool scene_saved_tags_on_event(void* context, SceneManagerEvent event) {
     App* app = context;
     bool consumed = false;
@@ -1008,6 +1064,34 @@ bool scene_saved_tags_on_event(void* context, SceneManagerEvent event) {
         if(event.event == EventSavedTagSelected) {
             scene_manager_next_scene(app->scene_manager, SceneSavedTagView);
             consumed = true;
+        } else if(event.event == EventSavedTagsNext) {
+            // The look-ahead entry starts the next page
+            app->saved_cursor = app->saved_page->items[app->saved_page->count];
+            app->saved_cursor_set = true;
+            saved_tags_fetch_page(app, SavedTagsFetchPage);
+            consumed = true;
+        } else if(event.event == EventSavedTagsPrevious) {
+            saved_tags_fetch_page(app, SavedTagsFetchPrevious);
+            consumed = true;
+        } else if(event.event == EventSortTags) {
+            app->saved_tags_sort = (app->saved_tags_sort + 1) % SavedTagsSortCount;
+            app->saved_cursor_set = false;
+            saved_tags_fetch_page(app, SavedTagsFetchSort);
+            consumed = true;
+        } else if(event.event == EventMigrateTags) {
+            // v1 text files to v2 records (or into the tag database), the
+            // page request runs after the migration
+            storage_worker_migrate(app->storage_worker);
+            app->saved_cursor_set = false;
+            saved_tags_fetch_page(app, SavedTagsFetchMigrated);
+            consumed = true;
+        } else if(event.event == EventSavedTagsPageLoaded) {
+            saved_tags_show_page(app);
+            consumed = true;
+        } else if(event.event == EventTagDeleteFailed) {
+            // Posted after the tag view returned here
+            notification_message(app->notifications, &sequence_error);
+            consumed = true;
         }
     }
     return consumed;
@@ -1016,6 +1100,8 @@ bool scene_saved_tags_on_event(void* context, SceneManagerEvent event) {
 void scene_saved_tags_on_exit(void* context) {
     App* app = context;
     submenu_reset(app->submenu);
+    free(app->saved_page);
+    app->saved_page = NULL;
 }
 
 // ============================================
@@ -1034,14 +1120,13 @@ static void saved_tag_view_button_callback(GuiButtonType result, InputType type,
     }
 }
 
-void scene_saved_tag_view_on_enter(void* context) {
-    App* app = context;
+// Show the tag the storage worker loaded, or that it failed to load
+static void saved_tag_view_show(App* app, bool loaded) {
     widget_reset(app->widget);
 
     FuriString* text = furi_string_alloc();
 
-    // Load tag data
-    if(load_tag_from_file(app, furi_string_get_cstr(app->saved_tag_path))) {
+    if(loaded) {
         // Extract info for display
         char material_id[9];
         extract_string(app->read_data.block1, 8, 8, material_id);
@@ -1069,14 +1154,7 @@ void scene_saved_tag_view_on_enter(void* context) {
         uint16_t weight = app->read_data.block5[4] | (app->read_data.block5[5] << 8);
 
         char uid_str[32];
-        snprintf(
-            uid_str,
-            sizeof(uid_str),
-            "%02X:%02X:%02X:%02X",
-            app->tag_data.uid[0],
-            app->tag_data.uid[1],
-            app->tag_data.uid[2],
-            app->tag_data.uid[3]);
+        format_uid(app, uid_str, sizeof(uid_str));
 
         furi_string_printf(
             text,
@@ -1092,6 +1170,9 @@ void scene_saved_tag_view_on_enter(void* context) {
             manufacturer,
             r, g, b,
             weight);
+        if(app->read_data.has_dump) {
+            append_dump_summary(app, text);
+        }
     } else {
         furi_string_printf(text, "Failed to load tag!");
     }
@@ -1105,11 +1186,20 @@ void scene_saved_tag_view_on_enter(void* context) {
         app->widget, GuiButtonTypeLeft, "Back", saved_tag_view_button_callback, app);
     widget_add_button_element(
         app->widget, GuiButtonTypeCenter, "Delete", saved_tag_view_button_callback, app);
-    if(app->read_data.valid) {
+    if(loaded && app->read_data.valid) {
         widget_add_button_element(
             app->widget, GuiButtonTypeRight, "Clone", saved_tag_view_button_callback, app);
     }
+}
+
+void scene_saved_tag_view_on_enter(void* context) {
+    App* app = context;
 
+    // Buttons wait for the tag, Clone must not see the previous one
+    widget_reset(app->widget);
+    widget_add_string_element(
+        app->widget, 64, 26, AlignCenter, AlignCenter, FontSecondary, "Loading...");
+    storage_worker_load(app->storage_worker, furi_string_get_cstr(app->saved_tag_path));
     view_dispatcher_switch_to_view(app->view_dispatcher, ViewWidget);
 }
 
@@ -1130,11 +1220,17 @@ bool scene_saved_tag_view_on_event(void* context, SceneManagerEvent event) {
             const char* filename = strrchr(path, '/');
             if(filename) {
                 filename++; // Skip the '/'
-                delete_saved_tag(app, filename);
+                storage_worker_delete(app->storage_worker, filename);
             }
-            // Go back to saved tags list
+            // Go back to saved tags list, its page is fetched after the delete
             scene_manager_previous_scene(app->scene_manager);
             consumed = true;
+        } else if(event.event == EventTagLoaded || event.event == EventTagLoadFailed) {
+            saved_tag_view_show(
+                app,
+                event.event == EventTagLoaded &&
+                    storage_worker_take_loaded(app->storage_worker, app));
+            consumed = true;
         } else if(event.event == EventBack) {
             scene_manager_previous_scene(app->scene_manager);
             consumed = true;
@@ -1150,3 +1246,262 @@ void scene_saved_tag_view_on_exit(void* context) {
     App* app = context;
     widget_reset(app->widget);
 }
+
+// ============================================
+// Scene: Batch Write
+// ============================================
+// Programs every new blank tag presented with the confirmed settings. The
+// scanner is re-armed after each tag, UIDs already written are skipped.
+static void batch_remember_uid(App* app) {
+    BatchState* batch = &app->batch;
+    memcpy(batch->uids[batch->uid_next], app->tag_data.uid, app->tag_data.uid_len);
+    batch->uid_lens[batch->uid_next] = app->tag_data.uid_len;
+    batch->uid_next = (batch->uid_next + 1) % BATCH_MAX_UIDS;
+    if(batch->uid_count < BATCH_MAX_UIDS) batch->uid_count++;
+}
+
+// The last failed tag may be tapped again to resume it. It is counted as
+// failed only once a different tag is presented instead.
+static void batch_settle_failed(App* app) {
+    BatchState* batch = &app->batch;
+    if(batch->failed_uid_len != 0 &&
+       (batch->failed_uid_len != app->tag_data.uid_len ||
+        memcmp(batch->failed_uid, app->tag_data.uid, batch->failed_uid_len) != 0)) {
+        batch->failed++;
+        batch->failed_uid_len = 0;
+    }
+}
+
+// Redraw counters, rate and the status of the last tag
+static void batch_update_view(App* app, const char* status) {
+    const BatchState* batch = &app->batch;
+    const FilamentInfo* filament = &BAMBU_FILAMENTS[app->tag_data.filament_index];
+    const ColorPreset* color = &COLOR_PRESETS[app->tag_data.color_index];
+
+    // Tags per minute in tenths, integer math only
+    uint32_t rate_x10 = 0;
+    if(batch->start_tick != 0 && batch->written > 0) {
+        uint64_t elapsed_ms = (uint64_t)(furi_get_tick() - batch->start_tick) * 1000 /
+                              furi_kernel_get_tick_frequency();
+        if(elapsed_ms > 0) {
+            rate_x10 = (uint32_t)((uint64_t)batch->written * 600000 / elapsed_ms);
+        }
+    }
+
+    furi_string_printf(
+        app->result_text,
+        "Batch: %s %s\n"
+        "Written: %d  Failed: %d\n"
+        "Bambu: %d  Rate: %lu.%lu/min\n\n"
+        "%s",
+        filament->filament_type,
+        color->name,
+        batch->written,
+        batch->failed + (batch->failed_uid_len != 0 ? 1 : 0),
+        batch->rejected,
+        (unsigned long)(rate_x10 / 10),
+        (unsigned long)(rate_x10 % 10),
+        status);
+
+    widget_reset(app->widget);
+    widget_add_text_scroll_element(
+        app->widget, 0, 0, 128, 64, furi_string_get_cstr(app->result_text));
+}
+
+void scene_batch_write_on_enter(void* context) {
+    App* app = context;
+
+    memset(&app->batch, 0, sizeof(app->batch));
+    app->batch_active = true;
+    app->write_in_progress = false;
+
+    batch_update_view(app, "Place next tag...");
+    view_dispatcher_switch_to_view(app->view_dispatcher, ViewWidget);
+
+    nfc_session_detect(app->nfc_session);
+}
+
+bool scene_batch_write_on_event(void* context, SceneManagerEvent event) {
+    App* app = context;
+    bool consumed = false;
+
+    if(event.type != SceneManagerEventTypeCustom) {
+        return consumed;
+    }
+
+    if(event.event == EventTagDetected &&
+       nfc_session_get_op(app->nfc_session) == NfcSessionOpDetect) {
+        if(app->batch.start_tick == 0) {
+            app->batch.start_tick = furi_get_tick();
+        }
+
+        // Detect, derive keys, write and verify in one session
+        app->write_success = false;
+        app->write_in_progress = true;
+        for(size_t i = 0; i < WRITE_BLOCK_COUNT; i++) {
+            app->write_status[i] = WriteBlockStatusPending;
+        }
+        batch_update_view(app, "Writing...");
+        nfc_session_write(app->nfc_session, true);
+        consumed = true;
+    } else if(event.event == EventTagTypeDetected && app->write_in_progress) {
+        // The write session stopped before writing anything
+        app->write_in_progress = false;
+
+        // Unknown also covers a UID that could not be read, which may be stale
+        if(app->detected_tag_type != TagTypeUnknown) batch_settle_failed(app);
+
+        if(app->detected_tag_type == TagTypeBambu) {
+            app->batch.rejected++;
+            batch_update_view(app, "Bambu tag skipped,\nplace next tag");
+            notification_message(app->notifications, &sequence_error);
+        } else if(app->detected_tag_type == TagTypeBlank && batch_uid_seen(app)) {
+            batch_update_view(app, "Already written,\nplace next tag");
+        } else {
+            batch_update_view(app, "Unsupported tag,\nplace next tag");
+        }
+        nfc_session_detect(app->nfc_session);
+        consumed = true;
+    } else if(
+        (event.event == EventWriteSuccess || event.event == EventWriteFailed ||
+         event.event == EventWriteInterrupted || event.event == EventWriteWrongTag) &&
+        app->write_in_progress) {
+        app->write_in_progress = false;
+
+        batch_settle_failed(app);
+        if(event.event == EventWriteSuccess) {
+            // A resumed tag is no longer failed
+            app->batch.failed_uid_len = 0;
+            app->batch.written++;
+            batch_remember_uid(app);
+            batch_update_view(app, "Done! Place next tag");
+            notification_message(app->notifications, &sequence_success);
+        } else {
+            // An interrupted tag resumes from the write journal when tapped again
+            memcpy(app->batch.failed_uid, app->tag_data.uid, app->tag_data.uid_len);
+            app->batch.failed_uid_len = app->tag_data.uid_len;
+            batch_update_view(app, "Write failed,\ntap again to resume");
+            notification_message(app->notifications, &sequence_error);
+        }
+        nfc_session_detect(app->nfc_session);
+        consumed = true;
+    }
+    return consumed;
+}
+
+void scene_batch_write_on_exit(void* context) {
+    App* app = context;
+    widget_reset(app->widget);
+    nfc_session_cancel(app->nfc_session);
+    app->batch_active = false;
+    app->write_in_progress = false;
+}
+
+// ============================================
+// Scene: Inventory
+// ============================================
+// Reads every spool tag swept past the Flipper, once per UID, and appends a
+// record per tag to the inventory log.
+static void inventory_update_view(App* app, const char* status) {
+    const InventoryState* inventory = app->inventory;
+
+    furi_string_printf(app->result_text, "Inventory: %d tags\n", inventory->count);
+    if(inventory->count > 0) {
+        furi_string_cat_printf(
+            app->result_text,
+            "Last: %s\nColor: #%02X%02X%02X\n",
+            inventory->last_type,
+            inventory->last_rgb[0],
+            inventory->last_rgb[1],
+            inventory->last_rgb[2]);
+    }
+    if(inventory->log_failed) {
+        furi_string_cat_str(app->result_text, "SD log unavailable\n");
+    }
+    furi_string_cat_printf(app->result_text, "\n%s", status);
+
+    widget_reset(app->widget);
+    widget_add_text_scroll_element(
+        app->widget, 0, 0, 128, 64, furi_string_get_cstr(app->result_text));
+}
+
+void scene_inventory_on_enter(void* context) {
+    App* app = context;
+
+    app->inventory = malloc(sizeof(InventoryState));
+    memset(app->inventory, 0, sizeof(InventoryState));
+    inventory_log_open(app);
+    app->inventory_active = true;
+    app->full_dump = false;
+    app->read_in_progress = false;
+
+    inventory_update_view(app, "Sweep tags past\nFlipper's back");
+    view_dispatcher_switch_to_view(app->view_dispatcher, ViewWidget);
+
+    nfc_session_detect(app->nfc_session);
+}
+
+bool scene_inventory_on_event(void* context, SceneManagerEvent event) {
+    App* app = context;
+    bool consumed = false;
+
+    if(event.type != SceneManagerEventTypeCustom) {
+        return consumed;
+    }
+
+    if(event.event == EventInventoryLogFailed) {
+        app->inventory->log_failed = true;
+        inventory_update_view(
+            app,
+            inventory_uid_full(app) ? "UID set full, sweep\nstopped. Back to finish" :
+                                      "Sweep tags past\nFlipper's back");
+        consumed = true;
+    } else if(
+        event.event == EventTagDetected &&
+        nfc_session_get_op(app->nfc_session) == NfcSessionOpDetect) {
+        memset(&app->read_data, 0, sizeof(app->read_data));
+        app->read_success = false;
+        app->read_in_progress = true;
+        nfc_session_read(app->nfc_session, false);
+        consumed = true;
+    } else if(
+        (event.event == EventReadSuccess || event.event == EventReadFailed ||
+         event.event == EventReadDuplicate) &&
+        app->read_in_progress) {
+        app->read_in_progress = false;
+        bool sweep = true;
+
+        if(event.event == EventReadSuccess && inventory_uid_add(app)) {
+            char filament_type[17];
+            char detailed_type[17];
+            extract_string(app->read_data.block2, 0, 16, filament_type);
+            extract_string(app->read_data.block4, 0, 16, detailed_type);
+
+            strcpy(app->inventory->last_type, filament_type);
+            memcpy(app->inventory->last_rgb, app->read_data.block5, 3);
+            inventory_log_append(app, filament_type, detailed_type);
+
+            // A full UID set can't tell new tags from seen ones, so the sweep ends
+            sweep = !inventory_uid_full(app);
+            inventory_update_view(
+                app,
+                sweep ? "Sweep tags past\nFlipper's back" :
+                        "UID set full, sweep\nstopped. Back to finish");
+            notification_message(app->notifications, &sequence_single_vibro);
+        }
+        if(sweep) nfc_session_detect(app->nfc_session);
+        consumed = true;
+    }
+    return consumed;
+}
+
+void scene_inventory_on_exit(void* context) {
+    App* app = context;
+    widget_reset(app->widget);
+    nfc_session_cancel(app->nfc_session);
+    app->inventory_active = false;
+    app->read_in_progress = false;
+    inventory_log_close(app);
+    free(app->inventory);
+    app->inventory = NULL;
+}
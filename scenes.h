@@ -61,5 +61,10 @@ void scene_saved_tag_view_on_enter(void* context);
 bool scene_saved_tag_view_on_event(void* context, SceneManagerEvent event);
 void scene_saved_tag_view_on_exit(void* context);
 
-// Helper function for extracting strings from block data
-void extract_string(const uint8_t* data, size_t offset, size_t max_len, char* out);
+void scene_batch_write_on_enter(void* context);
+bool scene_batch_write_on_event(void* context, SceneManagerEvent event);
+void scene_batch_write_on_exit(void* context);
+
+void scene_inventory_on_enter(void* context);
+bool scene_inventory_on_event(void* context, SceneManagerEvent event);
+void scene_inventory_on_exit(void* context);
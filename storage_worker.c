@@ -0,0 +1,464 @@
+/**
+ * @file storage_worker.c
+ * @brief Storage worker: the scenes' SD card work on its own thread
+ * @author Tai Nguyen <taiducnguyen.drexel@gmail.com>
+ */
+
+#include "storage_worker.h"
+#include "key_cache.h"
+#include "tag_storage.h"
+
+#define STORAGE_WORKER_STACK 3072  // Manifest rebuilds parse v1 files on this stack
+
+#define WORKER_FLAG_WAKE (1 << 0)
+
+// Most saves written as one group
+#define STORAGE_WORKER_SAVE_GROUP TAG_MANIFEST_PUT_MAX
+
+typedef enum {
+    StorageRequestSave,
+    StorageRequestLoad,
+    StorageRequestDelete,
+    StorageRequestPage,
+    StorageRequestMigrate,
+    StorageRequestAppend,
+    StorageRequestOpenLog,
+    StorageRequestCloseLog,
+    StorageRequestStartup,
+    StorageRequestWait,
+} StorageRequestType;
+
+typedef struct StorageRequest {
+    struct StorageRequest* next;
+    StorageRequestType type;
+    uint32_t sequence;  // Loads and pages, compared with the last one asked for
+    FuriString* text;   // Path to load, name to delete or data to append
+
+    union {
+        struct {
+            BtagRecord* record;
+            size_t size;
+        } save;
+        struct {
+            SavedTagsSort sort;
+            TagManifestCursor start;
+            bool has_start;
+            bool before;
+        } page;
+        File* file;
+        FuriSemaphore* done;
+    };
+} StorageRequest;
+
+struct StorageWorker {
+    App* app;
+    FuriThread* thread;
+    FuriMutex* mutex;  // Guards everything below
+
+    StorageRequest* head;
+    StorageRequest* tail;
+    bool stopping;
+    bool events_stopped;  // The view dispatcher is stopping, see post()
+
+    uint32_t load_sequence;
+    uint32_t page_sequence;
+    BtagRecord* loaded;
+    TagManifestPage* page;
+    uint16_t migrated;
+};
+
+// ============================================
+// Queue
+// ============================================
+static StorageRequest* request_alloc(StorageRequestType type) {
+    StorageRequest* request = malloc(sizeof(StorageRequest));
+    memset(request, 0, sizeof(StorageRequest));
+    request->type = type;
+    return request;
+}
+
+static void request_free(StorageRequest* request) {
+    if(request->text) furi_string_free(request->text);
+    if(request->type == StorageRequestSave) free(request->save.record);
+    free(request);
+}
+
+// Call with the mutex held
+static void queue_push_locked(StorageWorker* worker, StorageRequest* request) {
+    if(worker->tail) {
+        worker->tail->next = request;
+    } else {
+        worker->head = request;
+    }
+    worker->tail = request;
+    furi_thread_flags_set(furi_thread_get_id(worker->thread), WORKER_FLAG_WAKE);
+}
+
+static void queue_push(StorageWorker* worker, StorageRequest* request) {
+    furi_mutex_acquire(worker->mutex, FuriWaitForever);
+    queue_push_locked(worker, request);
+    furi_mutex_release(worker->mutex);
+}
+
+static StorageRequest* queue_pop(StorageWorker* worker) {
+    furi_mutex_acquire(worker->mutex, FuriWaitForever);
+    StorageRequest* request = worker->head;
+    if(request) {
+        worker->head = request->next;
+        if(!worker->head) worker->tail = NULL;
+    }
+    furi_mutex_release(worker->mutex);
+    return request;
+}
+
+// The request at the head if it is a save
+static StorageRequest* queue_pop_save(StorageWorker* worker) {
+    furi_mutex_acquire(worker->mutex, FuriWaitForever);
+    StorageRequest* request = worker->head;
+    if(request && request->type == StorageRequestSave) {
+        worker->head = request->next;
+        if(!worker->head) worker->tail = NULL;
+    } else {
+        request = NULL;
+    }
+    furi_mutex_release(worker->mutex);
+    return request;
+}
+
+// ============================================
+// Worker thread
+// ============================================
+// Sent without the mutex held, the GUI thread may be waiting on it while
+// the event queue is full
+static void post(StorageWorker* worker, AppEvent event) {
+    furi_mutex_acquire(worker->mutex, FuriWaitForever);
+    bool events_stopped = worker->events_stopped;
+    furi_mutex_release(worker->mutex);
+
+    if(!events_stopped) view_dispatcher_send_custom_event(worker->app->view_dispatcher, event);
+}
+
+static void run_load(StorageWorker* worker, StorageRequest* request) {
+    BtagRecord* record = malloc(sizeof(BtagRecord));
+    bool success = load_tag_record(worker->app->storage, furi_string_get_cstr(request->text), record);
+
+    furi_mutex_acquire(worker->mutex, FuriWaitForever);
+    bool current = request->sequence == worker->load_sequence;
+    if(current) {
+        free(worker->loaded);
+        worker->loaded = success ? record : NULL;
+    }
+    furi_mutex_release(worker->mutex);
+
+    if(!current || !success) free(record);
+    if(current) post(worker, success ? EventTagLoaded : EventTagLoadFailed);
+}
+
+static void run_page(StorageWorker* worker, StorageRequest* request) {
+    App* app = worker->app;
+    TagManifestPage* page = malloc(sizeof(TagManifestPage));
+    const TagManifestCursor* start = request->page.has_start ? &request->page.start : NULL;
+
+    sync_saved_tags(app);
+    if(request->page.before) {
+        tag_manifest_page_before(app->storage, request->page.sort, start, page);
+    } else {
+        tag_manifest_page_from(app->storage, request->page.sort, start, page);
+        // The last tags of the last page were deleted
+        if(page->count == 0 && page->first > 0 && start) {
+            tag_manifest_page_before(app->storage, request->page.sort, start, page);
+        }
+    }
+
+    furi_mutex_acquire(worker->mutex, FuriWaitForever);
+    bool current = request->sequence == worker->page_sequence;
+    if(current) {
+        free(worker->page);
+        worker->page = page;
+    }
+    furi_mutex_release(worker->mutex);
+
+    if(current) {
+        post(worker, EventSavedTagsPageLoaded);
+    } else {
+        free(page);
+    }
+}
+
+// Write a save and the saves queued right behind it as one group. Saves pile
+// up while the card is busy, and each group costs one manifest update
+// instead of one per tag.
+static void run_saves(StorageWorker* worker, StorageRequest* first) {
+    StorageRequest* requests[STORAGE_WORKER_SAVE_GROUP];
+    TagSave saves[STORAGE_WORKER_SAVE_GROUP];
+    uint8_t count = 1;
+
+    requests[0] = first;
+    while(count < STORAGE_WORKER_SAVE_GROUP && (requests[count] = queue_pop_save(worker)) != NULL) {
+        count++;
+    }
+    for(uint8_t i = 0; i < count; i++) {
+        saves[i].record = requests[i]->save.record;
+        saves[i].size = requests[i]->save.size;
+    }
+
+    save_tag_records(worker->app->storage, saves, count);
+    for(uint8_t i = 0; i < count; i++) {
+        post(worker, saves[i].saved ? EventTagSaved : EventTagSaveFailed);
+        // The first is freed by the caller
+        if(i > 0) request_free(requests[i]);
+    }
+}
+
+static void run_request(StorageWorker* worker, StorageRequest* request) {
+    App* app = worker->app;
+    bool success;
+
+    switch(request->type) {
+    case StorageRequestSave:
+        run_saves(worker, request);
+        break;
+    case StorageRequestLoad:
+        run_load(worker, request);
+        break;
+    case StorageRequestDelete:
+        success = delete_saved_tag(app->storage, furi_string_get_cstr(request->text));
+        post(worker, success ? EventTagDeleted : EventTagDeleteFailed);
+        break;
+    case StorageRequestPage:
+        run_page(worker, request);
+        break;
+    case StorageRequestMigrate: {
+        uint16_t migrated = migrate_saved_tags(app);
+        furi_mutex_acquire(worker->mutex, FuriWaitForever);
+        worker->migrated = migrated;
+        furi_mutex_release(worker->mutex);
+        post(worker, EventTagsMigrated);
+        break;
+    }
+    case StorageRequestAppend: {
+        // Dropped if the log could not be opened, that was reported then
+        size_t size = furi_string_size(request->text);
+        if(storage_file_is_open(request->file) &&
+           storage_file_write(request->file, furi_string_get_cstr(request->text), size) != size) {
+            FURI_LOG_E(TAG, "Storage worker: append failed");
+        }
+        break;
+    }
+    case StorageRequestOpenLog:
+        if(!inventory_log_open_file(app->storage, request->file)) {
+            post(worker, EventInventoryLogFailed);
+        }
+        break;
+    case StorageRequestCloseLog:
+        if(storage_file_is_open(request->file)) storage_file_close(request->file);
+        storage_file_free(request->file);
+        break;
+    case StorageRequestStartup:
+        // Saves an earlier run was cut short in, before the manifest is checked
+        recover_saved_tags(app);
+        key_cache_load(app->key_cache, app->storage);
+        key_cache_warm(app->key_cache, app);
+        break;
+    case StorageRequestWait:
+        furi_semaphore_release(request->done);
+        break;
+    }
+}
+
+static int32_t storage_worker_thread(void* context) {
+    StorageWorker* worker = context;
+    uint32_t requests = 0;
+
+    for(;;) {
+        StorageRequest* request;
+        while((request = queue_pop(worker)) != NULL) {
+            run_request(worker, request);
+            request_free(request);
+            requests++;
+        }
+
+        // Requests made before stopping have all run by now
+        furi_mutex_acquire(worker->mutex, FuriWaitForever);
+        bool stop = worker->stopping && !worker->head;
+        furi_mutex_release(worker->mutex);
+        if(stop) break;
+
+        furi_thread_flags_wait(WORKER_FLAG_WAKE, FuriFlagWaitAny, FuriWaitForever);
+    }
+
+    FURI_LOG_I(TAG, "Storage worker: %lu requests", (unsigned long)requests);
+    return 0;
+}
+
+// ============================================
+// Requests
+// ============================================
+StorageWorker* storage_worker_alloc(App* app) {
+    StorageWorker* worker = malloc(sizeof(StorageWorker));
+    memset(worker, 0, sizeof(StorageWorker));
+
+    worker->app = app;
+    worker->mutex = furi_mutex_alloc(FuriMutexTypeNormal);
+    worker->thread =
+        furi_thread_alloc_ex("BambuStorage", STORAGE_WORKER_STACK, storage_worker_thread, worker);
+    furi_thread_start(worker->thread);
+
+    return worker;
+}
+
+void storage_worker_free(StorageWorker* worker) {
+    furi_mutex_acquire(worker->mutex, FuriWaitForever);
+    worker->stopping = true;
+    worker->events_stopped = true;
+    furi_thread_flags_set(furi_thread_get_id(worker->thread), WORKER_FLAG_WAKE);
+    furi_mutex_release(worker->mutex);
+
+    furi_thread_join(worker->thread);
+    furi_thread_free(worker->thread);
+    furi_mutex_free(worker->mutex);
+    free(worker->loaded);
+    free(worker->page);
+    free(worker);
+}
+
+void storage_worker_stop_events(StorageWorker* worker) {
+    furi_mutex_acquire(worker->mutex, FuriWaitForever);
+    worker->events_stopped = true;
+    furi_mutex_release(worker->mutex);
+}
+
+static bool same_uid(const BtagHeader* a, const BtagHeader* b) {
+    return a->uid_len == b->uid_len && memcmp(a->uid, b->uid, a->uid_len) == 0;
+}
+
+void storage_worker_save(StorageWorker* worker, const App* app) {
+    // Copied here, the NFC thread may read the next tag into read_data
+    BtagRecord* record = malloc(sizeof(BtagRecord));
+    size_t size = btag_record_from_app(app, record);
+
+    furi_mutex_acquire(worker->mutex, FuriWaitForever);
+    StorageRequest* pending = worker->head;
+    while(pending &&
+          !(pending->type == StorageRequestSave && same_uid(&pending->save.record->header, &record->header))) {
+        pending = pending->next;
+    }
+    if(pending) {
+        free(pending->save.record);
+        pending->save.record = record;
+        pending->save.size = size;
+    } else {
+        StorageRequest* request = request_alloc(StorageRequestSave);
+        request->save.record = record;
+        request->save.size = size;
+        queue_push_locked(worker, request);
+    }
+    furi_mutex_release(worker->mutex);
+}
+
+void storage_worker_load(StorageWorker* worker, const char* path) {
+    StorageRequest* request = request_alloc(StorageRequestLoad);
+    request->text = furi_string_alloc_set_str(path);
+
+    furi_mutex_acquire(worker->mutex, FuriWaitForever);
+    request->sequence = ++worker->load_sequence;
+    free(worker->loaded);
+    worker->loaded = NULL;
+    queue_push_locked(worker, request);
+    furi_mutex_release(worker->mutex);
+}
+
+bool storage_worker_take_loaded(StorageWorker* worker, App* app) {
+    furi_mutex_acquire(worker->mutex, FuriWaitForever);
+    BtagRecord* record = worker->loaded;
+    worker->loaded = NULL;
+    furi_mutex_release(worker->mutex);
+
+    if(!record) return false;
+    btag_record_to_app(record, app);
+    free(record);
+    return true;
+}
+
+void storage_worker_delete(StorageWorker* worker, const char* name) {
+    StorageRequest* request = request_alloc(StorageRequestDelete);
+    request->text = furi_string_alloc_set_str(name);
+    queue_push(worker, request);
+}
+
+void storage_worker_page(
+    StorageWorker* worker,
+    SavedTagsSort sort,
+    const TagManifestCursor* start,
+    bool before) {
+    StorageRequest* request = request_alloc(StorageRequestPage);
+    request->page.sort = sort;
+    request->page.before = before;
+    if(start) {
+        request->page.start = *start;
+        request->page.has_start = true;
+    }
+
+    furi_mutex_acquire(worker->mutex, FuriWaitForever);
+    request->sequence = ++worker->page_sequence;
+    free(worker->page);
+    worker->page = NULL;
+    queue_push_locked(worker, request);
+    furi_mutex_release(worker->mutex);
+}
+
+bool storage_worker_take_page(StorageWorker* worker, TagManifestPage* page) {
+    furi_mutex_acquire(worker->mutex, FuriWaitForever);
+    TagManifestPage* fetched = worker->page;
+    worker->page = NULL;
+    furi_mutex_release(worker->mutex);
+
+    if(!fetched) return false;
+    memcpy(page, fetched, sizeof(TagManifestPage));
+    free(fetched);
+    return true;
+}
+
+void storage_worker_migrate(StorageWorker* worker) {
+    queue_push(worker, request_alloc(StorageRequestMigrate));
+}
+
+uint16_t storage_worker_get_migrated(StorageWorker* worker) {
+    furi_mutex_acquire(worker->mutex, FuriWaitForever);
+    uint16_t migrated = worker->migrated;
+    furi_mutex_release(worker->mutex);
+    return migrated;
+}
+
+void storage_worker_append(StorageWorker* worker, File* file, FuriString* data) {
+    StorageRequest* request = request_alloc(StorageRequestAppend);
+    request->file = file;
+    request->text = data;
+    queue_push(worker, request);
+}
+
+void storage_worker_open_log(StorageWorker* worker, File* file) {
+    StorageRequest* request = request_alloc(StorageRequestOpenLog);
+    request->file = file;
+    queue_push(worker, request);
+}
+
+void storage_worker_close_log(StorageWorker* worker, File* file) {
+    StorageRequest* request = request_alloc(StorageRequestCloseLog);
+    request->file = file;
+    queue_push(worker, request);
+}
+
+void storage_worker_startup(StorageWorker* worker) {
+    queue_push(worker, request_alloc(StorageRequestStartup));
+}
+
+void storage_worker_wait(StorageWorker* worker) {
+    StorageRequest* request = request_alloc(StorageRequestWait);
+    FuriSemaphore* done = furi_semaphore_alloc(1, 0);
+    request->done = done;
+    queue_push(worker, request);
+
+    furi_semaphore_acquire(done, FuriWaitForever);
+    furi_semaphore_free(done);
+}
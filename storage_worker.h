@@ -0,0 +1,78 @@
+/**
+ * @file storage_worker.h
+ * @brief Storage worker: the scenes' SD card work on its own thread
+ * @author Tai Nguyen <taiducnguyen.drexel@gmail.com>
+ */
+
+#pragma once
+
+#include "bambu_tagger.h"
+#include "tag_manifest.h"
+
+// Requests run one at a time, in the order they are made. Each carries its
+// own copy of what it needs, so the GUI thread returns at once and the NFC
+// thread can overwrite read_data while a save is still running. Completion
+// is reported through the app's custom events. Results with data (a loaded
+// tag, a page) are kept until taken; a newer request of the same kind makes
+// an older result stale, and stale results are dropped without an event.
+
+// Start the worker thread
+StorageWorker* storage_worker_alloc(App* app);
+
+// Run every queued request, then stop the thread and free the worker
+void storage_worker_free(StorageWorker* worker);
+
+// Post no more events. Call it before the view dispatcher stops, nothing
+// reads its queue after that and a full queue would block the worker.
+// Queued requests still run.
+void storage_worker_stop_events(StorageWorker* worker);
+
+// Save the tag in tag_data/read_data (and mf_data for dumps), posts
+// EventTagSaved or EventTagSaveFailed. A save of the same UID that has not
+// started yet is replaced instead, so a tag is never written twice in a row.
+void storage_worker_save(StorageWorker* worker, const App* app);
+
+// Load a saved tag, posts EventTagLoaded or EventTagLoadFailed
+void storage_worker_load(StorageWorker* worker, const char* path);
+
+// Put the loaded tag in tag_data/read_data (and mf_data), false if there is none
+bool storage_worker_take_loaded(StorageWorker* worker, App* app);
+
+// Delete a saved tag, posts EventTagDeleted or EventTagDeleteFailed
+void storage_worker_delete(StorageWorker* worker, const char* name);
+
+// Fetch the Saved Tags page from start (the top if NULL), or the page just
+// before start, posts EventSavedTagsPageLoaded. The manifest is checked
+// against the saved tags first, once per run.
+void storage_worker_page(
+    StorageWorker* worker,
+    SavedTagsSort sort,
+    const TagManifestCursor* start,
+    bool before);
+
+// Copy the fetched page into page, false if there is none
+bool storage_worker_take_page(StorageWorker* worker, TagManifestPage* page);
+
+// Convert old tag files, posts EventTagsMigrated
+void storage_worker_migrate(StorageWorker* worker);
+
+// Files converted by the last migration
+uint16_t storage_worker_get_migrated(StorageWorker* worker);
+
+// Finish saves an earlier run was cut short in, then load the key cache and
+// warm it from the saved tags. No event. Made first, so every later request
+// sees the recovered tags.
+void storage_worker_startup(StorageWorker* worker);
+
+// Open file as the inventory log, posts EventInventoryLogFailed if it can't be
+void storage_worker_open_log(StorageWorker* worker, File* file);
+
+// Append data to the inventory log and free it. No event; dropped if the log
+// did not open.
+void storage_worker_append(StorageWorker* worker, File* file, FuriString* data);
+
+// Close the inventory log after the appends before it and free file
+void storage_worker_close_log(StorageWorker* worker, File* file);
+
+// Return once every request made so far has run
+void storage_worker_wait(StorageWorker* worker);
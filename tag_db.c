@@ -0,0 +1,542 @@
+/**
+ * @file tag_db.c
+ * @brief Single-file append-only tag database with an on-disk UID hash index
+ * @author Tai Nguyen <taiducnguyen.drexel@gmail.com>
+ */
+
+#include "tag_db.h"
+
+#define TAG_DB_INDEX_MAGIC 0x58445442u  // "BTDX"
+#define TAG_DB_INDEX_VERSION 2
+
+#define SLOT_EMPTY 0
+#define SLOT_DELETED 0xFFFFFFFFu
+#define SLOT_NONE UINT32_MAX  // No slot found, the index could not be read
+
+#define LIST_CHUNK_SLOTS 16  // Slots read per storage call when listing
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t slot_count;  // Power of two
+    uint32_t used;        // Slots that are not empty, deleted ones included
+    uint32_t live;
+    uint32_t log_size;    // Log bytes the index covers
+    uint32_t dead_bytes;  // Log bytes of replaced records and tombstones
+} TagDbIndexHeader;
+
+// The index file is the header followed by slot_count of these
+typedef struct {
+    uint32_t offset;  // Log offset of the record + 1, or SLOT_EMPTY / SLOT_DELETED
+    uint16_t size;
+    uint8_t uid_len;
+    uint8_t uid[BAMBU_UID_MAX_LEN];
+    uint8_t reserved[3];
+} TagDbSlot;
+
+// Index built in RAM while scanning the log
+typedef struct {
+    TagDbIndexHeader header;
+    TagDbSlot* slots;
+} TagDbTable;
+
+// Header plus CRC, the whole of a tombstone
+typedef struct {
+    BtagHeader header;
+    uint32_t crc;
+} TagDbTombstone;
+
+static uint32_t uid_hash(const uint8_t* uid, uint8_t uid_len) {
+    uint32_t hash = 2166136261u;
+    for(uint8_t i = 0; i < uid_len; i++) {
+        hash ^= uid[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static bool slot_matches(const TagDbSlot* slot, const uint8_t* uid, uint8_t uid_len) {
+    return slot->offset != SLOT_EMPTY && slot->offset != SLOT_DELETED && slot->uid_len == uid_len &&
+           memcmp(slot->uid, uid, uid_len) == 0;
+}
+
+// Apply a record appended at offset to the slot probed for its UID
+static void slot_update(
+    TagDbIndexHeader* header,
+    TagDbSlot* slot,
+    bool found,
+    const BtagHeader* record,
+    uint32_t offset,
+    uint16_t size) {
+    if(found) header->dead_bytes += slot->size;
+
+    if(record->flags & BTAG_FLAG_DELETED) {
+        header->dead_bytes += size;
+        if(found) {
+            slot->offset = SLOT_DELETED;
+            header->live--;
+        }
+        return;
+    }
+
+    if(!found) {
+        if(slot->offset == SLOT_EMPTY) header->used++;
+        header->live++;
+    }
+    slot->offset = offset + 1;
+    slot->size = size;
+    slot->uid_len = record->uid_len;
+    memcpy(slot->uid, record->uid, record->uid_len);
+}
+
+// ============================================
+// Log
+// ============================================
+// Read the record at the file position, returns its size or 0 if it is
+// torn or corrupt. available is the log bytes left from the position.
+static size_t log_read_record(File* file, BtagRecord* record, uint32_t available) {
+    BtagHeader* header = &record->header;
+
+    if(available < sizeof(BtagHeader) ||
+       storage_file_read(file, header, sizeof(BtagHeader)) != sizeof(BtagHeader)) {
+        return 0;
+    }
+    if(header->magic != BTAG_MAGIC || header->uid_len > sizeof(((TagDbSlot*)0)->uid)) return 0;
+
+    size_t size = btag_record_size(header);
+    size_t rest = size - sizeof(BtagHeader);
+    if(size > sizeof(BtagRecord) || size > available ||
+       storage_file_read(file, (uint8_t*)record + sizeof(BtagHeader), rest) != rest) {
+        return 0;
+    }
+    return btag_record_check(record, size) ? size : 0;
+}
+
+static bool log_append(Storage* storage, const void* data, size_t size) {
+    File* file = storage_file_alloc(storage);
+    bool success = storage_file_open(file, TAG_DB_PATH, FSAM_WRITE, FSOM_OPEN_APPEND) &&
+                   storage_file_write(file, data, size) == size;
+    storage_file_close(file);
+    storage_file_free(file);
+    return success;
+}
+
+// A compaction cut short leaves the temp log. It is whole once the old log
+// is gone, otherwise the old log still is.
+static void tag_db_recover(Storage* storage) {
+    if(!storage_file_exists(storage, TAG_DB_TEMP_PATH)) return;
+
+    if(storage_file_exists(storage, TAG_DB_PATH)) {
+        storage_simply_remove(storage, TAG_DB_TEMP_PATH);
+    } else {
+        storage_common_rename(storage, TAG_DB_TEMP_PATH, TAG_DB_PATH);
+    }
+    FURI_LOG_W(TAG, "Tag DB: recovered from an unfinished compaction");
+}
+
+// ============================================
+// Index rebuild (RAM table)
+// ============================================
+static uint32_t table_probe(
+    const TagDbTable* table,
+    const uint8_t* uid,
+    uint8_t uid_len,
+    bool* found) {
+    uint32_t mask = table->header.slot_count - 1;
+    uint32_t insert = SLOT_NONE;
+
+    *found = false;
+    for(uint32_t i = uid_hash(uid, uid_len) & mask;; i = (i + 1) & mask) {
+        const TagDbSlot* slot = &table->slots[i];
+        if(slot_matches(slot, uid, uid_len)) {
+            *found = true;
+            return i;
+        }
+        if(slot->offset == SLOT_DELETED && insert == SLOT_NONE) insert = i;
+        if(slot->offset == SLOT_EMPTY) return insert != SLOT_NONE ? insert : i;
+    }
+}
+
+// Double the table, deleted slots are dropped on the way
+static void table_grow(TagDbTable* table) {
+    TagDbTable grown = {.header = table->header};
+    grown.header.slot_count *= 2;
+    grown.header.used = 0;
+    grown.slots = malloc(grown.header.slot_count * sizeof(TagDbSlot));
+    memset(grown.slots, 0, grown.header.slot_count * sizeof(TagDbSlot));
+
+    for(uint32_t i = 0; i < table->header.slot_count; i++) {
+        const TagDbSlot* slot = &table->slots[i];
+        if(slot->offset == SLOT_EMPTY || slot->offset == SLOT_DELETED) continue;
+        bool found;
+        grown.slots[table_probe(&grown, slot->uid, slot->uid_len, &found)] = *slot;
+        grown.header.used++;
+    }
+
+    free(table->slots);
+    *table = grown;
+}
+
+static void table_put(TagDbTable* table, const BtagHeader* record, uint32_t offset, uint16_t size) {
+    if((table->header.used + 1) * 4 > table->header.slot_count * 3) table_grow(table);
+
+    bool found;
+    uint32_t i = table_probe(table, record->uid, record->uid_len, &found);
+    slot_update(&table->header, &table->slots[i], found, record, offset, size);
+}
+
+// Scan the log, drop a torn tail and write a fresh index for what is left.
+// The table is in RAM while scanning, 16 bytes per slot.
+static bool tag_db_rebuild(Storage* storage, uint32_t slot_count) {
+    TagDbTable table = {
+        .header =
+            {
+                .magic = TAG_DB_INDEX_MAGIC,
+                .version = TAG_DB_INDEX_VERSION,
+                .slot_count = slot_count,
+            },
+    };
+    table.slots = malloc(slot_count * sizeof(TagDbSlot));
+    memset(table.slots, 0, slot_count * sizeof(TagDbSlot));
+    BtagRecord* record = malloc(sizeof(BtagRecord));
+    bool success = false;
+
+    tag_db_recover(storage);
+    File* file = storage_file_alloc(storage);
+    if(storage_file_open(file, TAG_DB_PATH, FSAM_READ_WRITE, FSOM_OPEN_ALWAYS)) {
+        uint32_t log_size = storage_file_size(file);
+        uint32_t offset = 0;
+
+        while(offset < log_size) {
+            size_t size = log_read_record(file, record, log_size - offset);
+            if(size == 0) break;
+            table_put(&table, &record->header, offset, size);
+            offset += size;
+        }
+        if(offset < log_size) {
+            FURI_LOG_W(TAG, "Tag DB: dropping %lu torn bytes", (unsigned long)(log_size - offset));
+            storage_file_seek(file, offset, true);
+            storage_file_truncate(file);
+        }
+        table.header.log_size = offset;
+        success = true;
+    }
+    storage_file_close(file);
+
+    if(success) {
+        size_t slots_size = table.header.slot_count * sizeof(TagDbSlot);
+        success = storage_file_open(file, TAG_DB_INDEX_PATH, FSAM_WRITE, FSOM_CREATE_ALWAYS) &&
+                  storage_file_write(file, &table.header, sizeof(TagDbIndexHeader)) ==
+                      sizeof(TagDbIndexHeader) &&
+                  storage_file_write(file, table.slots, slots_size) == slots_size;
+        storage_file_close(file);
+    }
+    storage_file_free(file);
+
+    if(success) {
+        FURI_LOG_I(
+            TAG,
+            "Tag DB: index rebuilt, %lu tags in %lu slots",
+            (unsigned long)table.header.live,
+            (unsigned long)table.header.slot_count);
+    }
+    free(record);
+    free(table.slots);
+    return success;
+}
+
+// ============================================
+// Index file
+// ============================================
+static bool index_read_slot(File* index, uint32_t i, TagDbSlot* slot) {
+    return storage_file_seek(index, sizeof(TagDbIndexHeader) + i * sizeof(TagDbSlot), true) &&
+           storage_file_read(index, slot, sizeof(TagDbSlot)) == sizeof(TagDbSlot);
+}
+
+static bool index_write_slot(File* index, uint32_t i, const TagDbSlot* slot) {
+    return storage_file_seek(index, sizeof(TagDbIndexHeader) + i * sizeof(TagDbSlot), true) &&
+           storage_file_write(index, slot, sizeof(TagDbSlot)) == sizeof(TagDbSlot);
+}
+
+static bool index_write_header(File* index, const TagDbIndexHeader* header) {
+    return storage_file_seek(index, 0, true) &&
+           storage_file_write(index, header, sizeof(TagDbIndexHeader)) == sizeof(TagDbIndexHeader);
+}
+
+// Open the index, rebuilt first if it is missing or does not cover the log
+static bool index_open(Storage* storage, File* index, TagDbIndexHeader* header) {
+    for(uint8_t attempt = 0; attempt < 2; attempt++) {
+        if(storage_file_open(index, TAG_DB_INDEX_PATH, FSAM_READ_WRITE, FSOM_OPEN_EXISTING)) {
+            FileInfo info;
+            uint64_t log_size =
+                storage_common_stat(storage, TAG_DB_PATH, &info) == FSE_OK ? info.size : 0;
+
+            if(storage_file_read(index, header, sizeof(TagDbIndexHeader)) ==
+                   sizeof(TagDbIndexHeader) &&
+               header->magic == TAG_DB_INDEX_MAGIC && header->version == TAG_DB_INDEX_VERSION &&
+               header->log_size == log_size) {
+                return true;
+            }
+            storage_file_close(index);
+        }
+        if(attempt == 0 && !tag_db_rebuild(storage, TAG_DB_INDEX_SLOTS)) break;
+    }
+    FURI_LOG_E(TAG, "Tag DB: index unavailable");
+    return false;
+}
+
+// Slot of a UID if found, else the slot a new record for it goes into.
+// Expected one read, the table is never more than 3/4 full.
+static uint32_t index_probe(
+    File* index,
+    const TagDbIndexHeader* header,
+    const uint8_t* uid,
+    uint8_t uid_len,
+    TagDbSlot* slot,
+    bool* found) {
+    uint32_t mask = header->slot_count - 1;
+    uint32_t insert = SLOT_NONE;
+    TagDbSlot insert_slot = {0};
+
+    *found = false;
+    uint32_t i = uid_hash(uid, uid_len) & mask;
+    for(uint32_t probes = 0; probes < header->slot_count; probes++, i = (i + 1) & mask) {
+        if(!index_read_slot(index, i, slot)) return SLOT_NONE;
+        if(slot_matches(slot, uid, uid_len)) {
+            *found = true;
+            return i;
+        }
+        if(slot->offset != SLOT_EMPTY && slot->offset != SLOT_DELETED) continue;
+        if(insert == SLOT_NONE) {
+            insert = i;
+            insert_slot = *slot;
+        }
+        if(slot->offset == SLOT_EMPTY) break;
+    }
+
+    if(insert != SLOT_NONE) *slot = insert_slot;
+    return insert;
+}
+
+// Append a record or tombstone to the log and point its UID's slot at it.
+// The slot is written before the header, an index whose header does not
+// match the log is rebuilt.
+static bool index_put(
+    Storage* storage,
+    File* index,
+    TagDbIndexHeader* header,
+    const void* data,
+    size_t size) {
+    const BtagHeader* record = data;
+    TagDbSlot slot;
+    bool found;
+
+    uint32_t i = index_probe(index, header, record->uid, record->uid_len, &slot, &found);
+    if(i == SLOT_NONE) return false;
+    if((record->flags & BTAG_FLAG_DELETED) && !found) return false;
+
+    if(!log_append(storage, data, size)) return false;
+    slot_update(header, &slot, found, record, header->log_size, size);
+    header->log_size += size;
+
+    return index_write_slot(index, i, &slot) && index_write_header(index, header);
+}
+
+// ============================================
+// Compaction
+// ============================================
+static bool tag_db_should_compact(const TagDbIndexHeader* header) {
+    return header->dead_bytes >= TAG_DB_COMPACT_BYTES &&
+           header->dead_bytes > header->log_size - header->dead_bytes;
+}
+
+// Copy the live records to a temp log in index order, swap it in and rebuild
+// the index. Cut short at any point, tag_db_recover() keeps a whole log.
+static void tag_db_compact(Storage* storage) {
+    File* index = storage_file_alloc(storage);
+    File* log = storage_file_alloc(storage);
+    File* temp = storage_file_alloc(storage);
+    BtagRecord* record = malloc(sizeof(BtagRecord));
+    TagDbIndexHeader header;
+    uint32_t compacted = 0;
+    bool success = false;
+
+    if(index_open(storage, index, &header) &&
+       storage_file_open(log, TAG_DB_PATH, FSAM_READ, FSOM_OPEN_EXISTING) &&
+       storage_file_open(temp, TAG_DB_TEMP_PATH, FSAM_WRITE, FSOM_CREATE_ALWAYS)) {
+        success = true;
+        for(uint32_t i = 0; i < header.slot_count && success; i++) {
+            TagDbSlot slot;
+            if(!index_read_slot(index, i, &slot)) {
+                success = false;
+            } else if(slot.offset != SLOT_EMPTY && slot.offset != SLOT_DELETED) {
+                // A slot too big for the buffer means a corrupt index, the old log stays
+                success = slot.size <= sizeof(BtagRecord) &&
+                          storage_file_seek(log, slot.offset - 1, true) &&
+                          storage_file_read(log, record, slot.size) == slot.size &&
+                          storage_file_write(temp, record, slot.size) == slot.size;
+                compacted += slot.size;
+            }
+        }
+        success = success && storage_file_sync(temp);
+    }
+    storage_file_close(temp);
+    storage_file_close(log);
+    storage_file_close(index);
+
+    if(success) {
+        storage_simply_remove(storage, TAG_DB_PATH);
+        storage_common_rename(storage, TAG_DB_TEMP_PATH, TAG_DB_PATH);
+        tag_db_rebuild(storage, header.slot_count);
+        FURI_LOG_I(
+            TAG,
+            "Tag DB: compacted %lu -> %lu bytes",
+            (unsigned long)header.log_size,
+            (unsigned long)compacted);
+    } else {
+        storage_simply_remove(storage, TAG_DB_TEMP_PATH);
+        FURI_LOG_E(TAG, "Tag DB: compaction failed");
+    }
+
+    free(record);
+    storage_file_free(temp);
+    storage_file_free(log);
+    storage_file_free(index);
+}
+
+// ============================================
+// Public API
+// ============================================
+// Append a record or tombstone, growing the index first if it is full
+static bool tag_db_put(Storage* storage, const void* data, size_t size) {
+    File* index = storage_file_alloc(storage);
+    TagDbIndexHeader header;
+    bool success = false;
+
+    if(index_open(storage, index, &header)) {
+        if((header.used + 1) * 4 > header.slot_count * 3) {
+            storage_file_close(index);
+            if(!tag_db_rebuild(storage, header.slot_count * 2) ||
+               !index_open(storage, index, &header)) {
+                storage_file_free(index);
+                return false;
+            }
+        }
+        success = index_put(storage, index, &header, data, size);
+    }
+    storage_file_close(index);
+    storage_file_free(index);
+
+    if(success && tag_db_should_compact(&header)) tag_db_compact(storage);
+    return success;
+}
+
+bool tag_db_save(Storage* storage, const BtagRecord* record, size_t size) {
+    if(record->header.uid_len > sizeof(((TagDbSlot*)0)->uid) || !btag_record_check(record, size)) {
+        FURI_LOG_E(TAG, "Tag DB: record not saved");
+        return false;
+    }
+    return tag_db_put(storage, record, size);
+}
+
+bool tag_db_load(Storage* storage, const uint8_t* uid, uint8_t uid_len, BtagRecord* record) {
+    File* index = storage_file_alloc(storage);
+    TagDbIndexHeader header;
+    TagDbSlot slot;
+    bool found = false;
+    bool success = false;
+
+    if(index_open(storage, index, &header)) {
+        index_probe(index, &header, uid, uid_len, &slot, &found);
+    }
+    storage_file_close(index);
+    storage_file_free(index);
+
+    if(found) {
+        File* log = storage_file_alloc(storage);
+        success = slot.size <= sizeof(BtagRecord) &&
+                  storage_file_open(log, TAG_DB_PATH, FSAM_READ, FSOM_OPEN_EXISTING) &&
+                  storage_file_seek(log, slot.offset - 1, true) &&
+                  storage_file_read(log, record, slot.size) == slot.size &&
+                  btag_record_check(record, slot.size) && record->header.uid_len == uid_len &&
+                  memcmp(record->header.uid, uid, uid_len) == 0;
+        storage_file_close(log);
+        storage_file_free(log);
+        if(!success) FURI_LOG_E(TAG, "Tag DB: corrupt record");
+    }
+    return success;
+}
+
+bool tag_db_delete(Storage* storage, const uint8_t* uid, uint8_t uid_len) {
+    if(uid_len == 0 || uid_len > sizeof(((TagDbSlot*)0)->uid)) return false;
+
+    TagDbTombstone tombstone;
+    memset(&tombstone, 0, sizeof(tombstone));
+    tombstone.header.magic = BTAG_MAGIC;
+    tombstone.header.version = BTAG_VERSION;
+    tombstone.header.flags = BTAG_FLAG_DELETED;
+    tombstone.header.uid_len = uid_len;
+    memcpy(tombstone.header.uid, uid, uid_len);
+    tombstone.crc = btag_crc32(0, &tombstone.header, sizeof(BtagHeader));
+
+    // Not sizeof(tombstone), that includes the padding after the CRC
+    return tag_db_put(storage, &tombstone, btag_record_size(&tombstone.header));
+}
+
+uint16_t tag_db_list(Storage* storage, TagDbListCallback callback, void* context) {
+    File* index = storage_file_alloc(storage);
+    TagDbIndexHeader header;
+    uint16_t count = 0;
+
+    // The slots follow the header, read in chunks straight through
+    if(index_open(storage, index, &header)) {
+        TagDbSlot slots[LIST_CHUNK_SLOTS];
+        for(uint32_t i = 0; i < header.slot_count; i += LIST_CHUNK_SLOTS) {
+            uint32_t chunk = MIN(header.slot_count - i, (uint32_t)LIST_CHUNK_SLOTS);
+            size_t size = chunk * sizeof(TagDbSlot);
+            if(storage_file_read(index, slots, size) != size) break;
+
+            for(uint32_t j = 0; j < chunk; j++) {
+                if(slots[j].offset == SLOT_EMPTY || slots[j].offset == SLOT_DELETED) continue;
+                callback(slots[j].uid, slots[j].uid_len, context);
+                count++;
+            }
+        }
+    }
+    storage_file_close(index);
+    storage_file_free(index);
+
+    return count;
+}
+
+uint16_t tag_db_for_each(Storage* storage, TagDbRecordCallback callback, void* context) {
+    File* index = storage_file_alloc(storage);
+    File* log = storage_file_alloc(storage);
+    BtagRecord* record = malloc(sizeof(BtagRecord));
+    TagDbIndexHeader header;
+    uint16_t count = 0;
+
+    if(index_open(storage, index, &header) &&
+       storage_file_open(log, TAG_DB_PATH, FSAM_READ, FSOM_OPEN_EXISTING)) {
+        for(uint32_t i = 0; i < header.slot_count; i++) {
+            TagDbSlot slot;
+            if(!index_read_slot(index, i, &slot)) break;
+            if(slot.offset == SLOT_EMPTY || slot.offset == SLOT_DELETED) continue;
+
+            if(slot.size <= sizeof(BtagRecord) && storage_file_seek(log, slot.offset - 1, true) &&
+               storage_file_read(log, record, slot.size) == slot.size &&
+               btag_record_check(record, slot.size)) {
+                callback(record, context);
+                count++;
+            }
+        }
+    }
+    storage_file_close(log);
+    storage_file_close(index);
+    free(record);
+    storage_file_free(log);
+    storage_file_free(index);
+
+    return count;
+}
@@ -0,0 +1,56 @@
+/**
+ * @file tag_db.h
+ * @brief Single-file append-only tag database with an on-disk UID hash index
+ * @author Tai Nguyen <taiducnguyen.drexel@gmail.com>
+ */
+
+#pragma once
+
+#include "bambu_tagger.h"
+#include "btag_format.h"
+
+// ============================================
+// Files
+// ============================================
+// The log is v2 records back to back. Saving a UID again appends a new
+// record, deleting appends a tombstone (a record with BTAG_FLAG_DELETED and
+// no blocks). The index is an open addressing table of full UIDs pointing at
+// the live record of each UID, so lookups read one slot and one record. It
+// stores the log size it covers; a log of any other size (a save cut short)
+// has its torn tail dropped and the index is rebuilt from it.
+#define TAG_DB_PATH BAMBU_TAGGER_FOLDER "/tags.db"
+#define TAG_DB_INDEX_PATH BAMBU_TAGGER_FOLDER "/tags.idx"
+#define TAG_DB_TEMP_PATH BAMBU_TAGGER_FOLDER "/tags.db.tmp"  // Log being compacted
+
+// Index slots of a new database, doubled whenever the table is 3/4 full
+#ifndef TAG_DB_INDEX_SLOTS
+#define TAG_DB_INDEX_SLOTS 256
+#endif
+
+// Replaced and deleted records are compacted away once they take up this
+// many bytes and more than the live records do
+#ifndef TAG_DB_COMPACT_BYTES
+#define TAG_DB_COMPACT_BYTES 16384
+#endif
+
+// Called for every live UID, in index order
+typedef void (*TagDbListCallback)(const uint8_t* uid, uint8_t uid_len, void* context);
+
+// Called for every live record, in index order
+typedef void (*TagDbRecordCallback)(const BtagRecord* record, void* context);
+
+// Append a checked record, replacing any earlier record of its UID
+bool tag_db_save(Storage* storage, const BtagRecord* record, size_t size);
+
+// Read the live record of a UID, false if there is none or it fails its CRC
+bool tag_db_load(Storage* storage, const uint8_t* uid, uint8_t uid_len, BtagRecord* record);
+
+// Append a tombstone for a UID, false if it has no live record
+bool tag_db_delete(Storage* storage, const uint8_t* uid, uint8_t uid_len);
+
+// Call back for each live UID from the index alone, returns the count
+uint16_t tag_db_list(Storage* storage, TagDbListCallback callback, void* context);
+
+// Call back with each live record, read from the log. The database files
+// are open during the callback, it must not call the other tag_db functions.
+uint16_t tag_db_for_each(Storage* storage, TagDbRecordCallback callback, void* context);
@@ -0,0 +1,423 @@
+/**
+ * @file tag_manifest.c
+ * @brief Manifest of saved tag metadata for the Saved Tags list
+ * @author Tai Nguyen <taiducnguyen.drexel@gmail.com>
+ */
+
+#include "tag_manifest.h"
+
+#define TAG_MANIFEST_MAGIC 0x464D5442u  // "BTMF"
+#define TAG_MANIFEST_VERSION 2
+
+#define FIND_CHUNK_ENTRIES 8  // Entries read per storage call when searching
+
+static uint32_t entry_offset(uint16_t index) {
+    return sizeof(TagManifestHeader) + index * sizeof(TagManifestEntry);
+}
+
+uint32_t tag_manifest_name_hash(const char* name) {
+    uint32_t hash = 2166136261u;
+    for(; *name; name++) {
+        hash ^= (uint8_t)*name;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// A block of the record, zeros if it is missing
+static const uint8_t* record_block(const BtagRecord* record, uint8_t block) {
+    static const uint8_t zeros[16] = {0};
+    const uint8_t* data = btag_record_block(record, block);
+    return data ? data : zeros;
+}
+
+void tag_manifest_entry_from_record(const BtagRecord* record, const char* name, TagManifestEntry* entry) {
+    const uint8_t* block5 = record_block(record, 5);
+
+    memset(entry, 0, sizeof(TagManifestEntry));
+    snprintf(entry->name, sizeof(entry->name), "%s", name);
+    entry->uid_len = MIN(record->header.uid_len, sizeof(entry->uid));
+    memcpy(entry->uid, record->header.uid, entry->uid_len);
+
+    extract_string(record_block(record, 1), 8, 8, entry->material_id);
+    extract_string(record_block(record, 4), 0, 16, entry->type);
+    if(entry->type[0] == '\0') extract_string(record_block(record, 2), 0, 16, entry->type);
+    extract_string(record_block(record, 6), 0, 16, entry->manufacturer);
+    memcpy(entry->rgba, block5, sizeof(entry->rgba));
+    entry->weight = block5[4] | (block5[5] << 8);
+}
+
+static bool read_header(File* file, TagManifestHeader* header) {
+    return storage_file_read(file, header, sizeof(TagManifestHeader)) == sizeof(TagManifestHeader) &&
+           header->magic == TAG_MANIFEST_MAGIC && header->version == TAG_MANIFEST_VERSION;
+}
+
+static bool write_header(File* file, const TagManifestHeader* header) {
+    return storage_file_seek(file, 0, true) &&
+           storage_file_write(file, header, sizeof(TagManifestHeader)) == sizeof(TagManifestHeader);
+}
+
+static bool write_entry(File* file, uint16_t index, const TagManifestEntry* entry) {
+    return storage_file_seek(file, entry_offset(index), true) &&
+           storage_file_write(file, entry, sizeof(TagManifestEntry)) == sizeof(TagManifestEntry);
+}
+
+// Index of the entry with each of the count names, header->count for those
+// with none. Reads straight through from just after the header, once for
+// all the names.
+static void find_entries(
+    File* file,
+    const TagManifestHeader* header,
+    const TagManifestEntry* names,
+    uint16_t* indexes,
+    uint8_t count) {
+    TagManifestEntry entries[FIND_CHUNK_ENTRIES];
+    uint8_t missing = count;
+
+    for(uint8_t k = 0; k < count; k++) indexes[k] = header->count;
+    for(uint16_t i = 0; i < header->count && missing > 0; i += FIND_CHUNK_ENTRIES) {
+        uint16_t chunk = MIN(header->count - i, FIND_CHUNK_ENTRIES);
+        size_t size = chunk * sizeof(TagManifestEntry);
+        if(storage_file_read(file, entries, size) != size) break;
+
+        for(uint16_t j = 0; j < chunk; j++) {
+            for(uint8_t k = 0; k < count; k++) {
+                if(indexes[k] == header->count &&
+                   strncmp(entries[j].name, names[k].name, sizeof(entries[j].name)) == 0) {
+                    indexes[k] = i + j;
+                    missing--;
+                }
+            }
+        }
+    }
+}
+
+static uint16_t find_entry(File* file, const TagManifestHeader* header, const char* name) {
+    TagManifestEntry entry;
+    uint16_t index;
+
+    snprintf(entry.name, sizeof(entry.name), "%s", name);
+    find_entries(file, header, &entry, &index, 1);
+    return index;
+}
+
+bool tag_manifest_read_header(Storage* storage, TagManifestHeader* header) {
+    File* file = storage_file_alloc(storage);
+    bool success = storage_file_open(file, TAG_MANIFEST_PATH, FSAM_READ, FSOM_OPEN_EXISTING) &&
+                   read_header(file, header);
+    storage_file_close(file);
+    storage_file_free(file);
+    return success;
+}
+
+uint16_t tag_manifest_read(Storage* storage, uint16_t first, TagManifestEntry* entries, uint16_t count) {
+    File* file = storage_file_alloc(storage);
+    TagManifestHeader header;
+    uint16_t read = 0;
+
+    if(storage_file_open(file, TAG_MANIFEST_PATH, FSAM_READ, FSOM_OPEN_EXISTING) &&
+       read_header(file, &header) && first < header.count) {
+        count = MIN(count, header.count - first);
+        size_t size = count * sizeof(TagManifestEntry);
+        if(storage_file_seek(file, entry_offset(first), true) &&
+           storage_file_read(file, entries, size) == size) {
+            read = count;
+        }
+    }
+    storage_file_close(file);
+    storage_file_free(file);
+    return read;
+}
+
+bool tag_manifest_put(Storage* storage, const TagManifestEntry* entry) {
+    return tag_manifest_put_many(storage, entry, 1);
+}
+
+bool tag_manifest_put_many(Storage* storage, const TagManifestEntry* entries, uint8_t count) {
+    File* file = storage_file_alloc(storage);
+    TagManifestHeader header;
+    uint16_t indexes[TAG_MANIFEST_PUT_MAX];
+    bool success = false;
+
+    // A missing manifest is left missing, the next list builds it in full
+    if(count <= TAG_MANIFEST_PUT_MAX &&
+       storage_file_open(file, TAG_MANIFEST_PATH, FSAM_READ_WRITE, FSOM_OPEN_EXISTING) &&
+       read_header(file, &header)) {
+        uint16_t found = header.count;
+        find_entries(file, &header, entries, indexes, count);
+
+        success = true;
+        for(uint8_t k = 0; k < count && success; k++) {
+            // New names are added at the end, a name given twice once
+            if(indexes[k] == found) {
+                for(uint8_t earlier = 0; earlier < k; earlier++) {
+                    if(indexes[earlier] >= found &&
+                       strncmp(entries[earlier].name, entries[k].name, sizeof(entries[k].name)) == 0) {
+                        indexes[k] = indexes[earlier];
+                    }
+                }
+            }
+            if(indexes[k] == found) {
+                indexes[k] = header.count++;
+                header.names_hash ^= tag_manifest_name_hash(entries[k].name);
+            }
+            success = write_entry(file, indexes[k], &entries[k]);
+        }
+        if(success && header.count != found) success = write_header(file, &header);
+    }
+    storage_file_close(file);
+    storage_file_free(file);
+    return success;
+}
+
+bool tag_manifest_remove(Storage* storage, const char* name) {
+    File* file = storage_file_alloc(storage);
+    TagManifestHeader header;
+    bool success = false;
+
+    if(storage_file_open(file, TAG_MANIFEST_PATH, FSAM_READ_WRITE, FSOM_OPEN_EXISTING) &&
+       read_header(file, &header)) {
+        uint16_t index = find_entry(file, &header, name);
+        if(index < header.count) {
+            uint16_t last = header.count - 1;
+            TagManifestEntry entry;
+            success = true;
+            if(index != last) {
+                success = storage_file_seek(file, entry_offset(last), true) &&
+                          storage_file_read(file, &entry, sizeof(entry)) == sizeof(entry) &&
+                          write_entry(file, index, &entry);
+            }
+            if(success) {
+                header.count = last;
+                header.names_hash ^= tag_manifest_name_hash(name);
+                success = storage_file_seek(file, entry_offset(last), true) &&
+                          storage_file_truncate(file) && write_header(file, &header);
+            }
+        }
+    }
+    storage_file_close(file);
+    storage_file_free(file);
+    return success;
+}
+
+File* tag_manifest_create(Storage* storage, TagManifestHeader* header) {
+    File* file = storage_file_alloc(storage);
+
+    memset(header, 0, sizeof(TagManifestHeader));
+    header->magic = TAG_MANIFEST_MAGIC;
+    header->version = TAG_MANIFEST_VERSION;
+
+    // The magic is only written by tag_manifest_finish(), a rebuild cut
+    // short is rebuilt again
+    TagManifestHeader empty = {0};
+    if(!storage_file_open(file, TAG_MANIFEST_PATH, FSAM_WRITE, FSOM_CREATE_ALWAYS) ||
+       storage_file_write(file, &empty, sizeof(empty)) != sizeof(empty)) {
+        storage_file_close(file);
+        storage_file_free(file);
+        return NULL;
+    }
+    return file;
+}
+
+bool tag_manifest_append(File* file, TagManifestHeader* header, const TagManifestEntry* entry) {
+    if(header->count == UINT16_MAX ||
+       storage_file_write(file, entry, sizeof(TagManifestEntry)) != sizeof(TagManifestEntry)) {
+        return false;
+    }
+    header->count++;
+    header->names_hash ^= tag_manifest_name_hash(entry->name);
+    return true;
+}
+
+bool tag_manifest_finish(File* file, const TagManifestHeader* header) {
+    bool success = write_header(file, header);
+    storage_file_close(file);
+    storage_file_free(file);
+    return success;
+}
+
+// ============================================
+// Pages
+// ============================================
+static int compare_color(const uint8_t* rgba_a, const uint8_t* rgba_b) {
+    // Grouped by the nearest preset, in preset order
+    int preset_a = color_preset_nearest(rgba_a[0], rgba_a[1], rgba_a[2]);
+    int preset_b = color_preset_nearest(rgba_b[0], rgba_b[1], rgba_b[2]);
+    return preset_a != preset_b ? preset_a - preset_b : memcmp(rgba_a, rgba_b, 3);
+}
+
+// Total order of the list, the name and then the manifest index break ties
+static int compare_cursors(SavedTagsSort sort, const TagManifestCursor* a, const TagManifestCursor* b) {
+    const TagManifestEntry* entry_a = &a->entry;
+    const TagManifestEntry* entry_b = &b->entry;
+    int result = 0;
+
+    switch(sort) {
+    case SavedTagsSortName:
+        result = strcmp(entry_a->name, entry_b->name);
+        break;
+    case SavedTagsSortType:
+        result = strcmp(entry_a->type, entry_b->type);
+        break;
+    case SavedTagsSortColor:
+        result = compare_color(entry_a->rgba, entry_b->rgba);
+        if(!result) result = strcmp(entry_a->type, entry_b->type);
+        break;
+    case SavedTagsSortWeight:
+        result = entry_a->weight - entry_b->weight;
+        if(!result) result = strcmp(entry_a->type, entry_b->type);
+        break;
+    default:
+        break;
+    }
+    if(!result) result = strcmp(entry_a->name, entry_b->name);
+    return result ? result : a->index - b->index;
+}
+
+// The entries nearest to start, picked in one pass: from start on, or just
+// before it when backward
+typedef struct {
+    SavedTagsSort sort;
+    const TagManifestCursor* start;
+    bool backward;
+    TagManifestCursor* best;  // Nearest to start first
+    uint16_t capacity;
+    uint16_t count;
+    uint16_t before;  // Entries that come before the page in the list
+} PageSelection;
+
+static void page_select(PageSelection* selection, const TagManifestCursor* cursor) {
+    int direction = selection->backward ? -1 : 1;
+
+    if(selection->start) {
+        int side = compare_cursors(selection->sort, cursor, selection->start);
+        if(selection->backward ? side >= 0 : side < 0) {
+            if(!selection->backward) selection->before++;
+            return;
+        }
+    }
+
+    // Insertion into a buffer the size of a page
+    uint16_t position = selection->count;
+    while(position > 0 &&
+          compare_cursors(selection->sort, cursor, &selection->best[position - 1]) * direction < 0) {
+        position--;
+    }
+    if(position == selection->capacity) {
+        if(selection->backward) selection->before++;
+        return;
+    }
+    if(selection->count == selection->capacity) {
+        selection->count--;
+        if(selection->backward) selection->before++;
+    }
+    memmove(
+        &selection->best[position + 1],
+        &selection->best[position],
+        (selection->count - position) * sizeof(TagManifestCursor));
+    selection->best[position] = *cursor;
+    selection->count++;
+}
+
+// One pass over the manifest, read a chunk at a time
+static void page_scan(Storage* storage, PageSelection* selection, TagManifestPage* page) {
+    File* file = storage_file_alloc(storage);
+    TagManifestEntry* chunk = malloc(FIND_CHUNK_ENTRIES * sizeof(TagManifestEntry));
+    TagManifestHeader header;
+    TagManifestCursor cursor;
+
+    page->total = 0;
+    if(storage_file_open(file, TAG_MANIFEST_PATH, FSAM_READ, FSOM_OPEN_EXISTING) &&
+       read_header(file, &header)) {
+        page->total = header.count;
+        for(uint16_t i = 0; i < header.count; i += FIND_CHUNK_ENTRIES) {
+            uint16_t count = MIN(header.count - i, FIND_CHUNK_ENTRIES);
+            size_t size = count * sizeof(TagManifestEntry);
+            if(storage_file_read(file, chunk, size) != size) break;
+
+            for(uint16_t j = 0; j < count; j++) {
+                cursor.entry = chunk[j];
+                cursor.index = i + j;
+                page_select(selection, &cursor);
+            }
+        }
+    }
+    storage_file_close(file);
+    storage_file_free(file);
+    free(chunk);
+}
+
+// Unsorted pages are the manifest entries from first on
+static void page_read(Storage* storage, uint16_t first, uint16_t count, TagManifestPage* page) {
+    TagManifestHeader header;
+    TagManifestEntry* entries = malloc(count * sizeof(TagManifestEntry));
+
+    page->total = tag_manifest_read_header(storage, &header) ? header.count : 0;
+    uint16_t read = tag_manifest_read(storage, first, entries, count);
+    for(uint16_t i = 0; i < read; i++) {
+        page->items[i].entry = entries[i];
+        page->items[i].index = first + i;
+    }
+    page->count = MIN(read, TAG_MANIFEST_PAGE_SIZE);
+    page->has_next = read > TAG_MANIFEST_PAGE_SIZE;
+    page->first = first;
+    free(entries);
+}
+
+void tag_manifest_page_from(
+    Storage* storage,
+    SavedTagsSort sort,
+    const TagManifestCursor* start,
+    TagManifestPage* page) {
+    if(sort == SavedTagsSortNone) {
+        page_read(storage, start ? start->index : 0, TAG_MANIFEST_PAGE_SIZE + 1, page);
+        return;
+    }
+
+    // One more than a page, the extra entry starts the next page
+    PageSelection selection = {
+        .sort = sort,
+        .start = start,
+        .best = page->items,
+        .capacity = TAG_MANIFEST_PAGE_SIZE + 1,
+    };
+    page_scan(storage, &selection, page);
+    page->count = MIN(selection.count, TAG_MANIFEST_PAGE_SIZE);
+    page->has_next = selection.count > TAG_MANIFEST_PAGE_SIZE;
+    page->first = selection.before;
+}
+
+void tag_manifest_page_before(
+    Storage* storage,
+    SavedTagsSort sort,
+    const TagManifestCursor* start,
+    TagManifestPage* page) {
+    TagManifestCursor next = *start;
+
+    if(sort == SavedTagsSortNone) {
+        uint16_t first = start->index > TAG_MANIFEST_PAGE_SIZE ? start->index - TAG_MANIFEST_PAGE_SIZE : 0;
+        page_read(storage, first, start->index - first, page);
+    } else {
+        PageSelection selection = {
+            .sort = sort,
+            .start = start,
+            .backward = true,
+            .best = page->items,
+            .capacity = TAG_MANIFEST_PAGE_SIZE,
+        };
+        page_scan(storage, &selection, page);
+
+        // Found nearest first, the page runs the other way
+        for(uint16_t i = 0; i < selection.count / 2; i++) {
+            TagManifestCursor swap = page->items[i];
+            page->items[i] = page->items[selection.count - 1 - i];
+            page->items[selection.count - 1 - i] = swap;
+        }
+        page->count = selection.count;
+        page->first = selection.before;
+    }
+
+    // start itself is the first entry of the next page
+    page->items[page->count] = next;
+    page->has_next = true;
+}
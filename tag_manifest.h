@@ -0,0 +1,88 @@
+/**
+ * @file tag_manifest.h
+ * @brief Manifest of saved tag metadata for the Saved Tags list
+ * @author Tai Nguyen <taiducnguyen.drexel@gmail.com>
+ */
+
+#pragma once
+
+#include "bambu_tagger.h"
+#include "btag_format.h"
+
+// ============================================
+// File layout
+// ============================================
+// The header, then count entries in no particular order. Saves and deletes
+// update it in place. The header keeps the number of tags and an XOR of the
+// hashes of their names, so tags added or removed behind the app's back
+// show up as a mismatch without opening any tag.
+#define TAG_MANIFEST_PATH BAMBU_TAGGER_FOLDER "/manifest.bin"
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t count;
+    uint32_t names_hash;  // XOR of tag_manifest_name_hash() of every entry
+} TagManifestHeader;
+
+// Hash of a tag name, XORed into TagManifestHeader::names_hash
+uint32_t tag_manifest_name_hash(const char* name);
+
+// Entry for a tag record, saved under name
+void tag_manifest_entry_from_record(const BtagRecord* record, const char* name, TagManifestEntry* entry);
+
+// Read the header, false if the manifest is missing or from another version
+bool tag_manifest_read_header(Storage* storage, TagManifestHeader* header);
+
+// Read up to count entries starting at entry first, returns the number read
+uint16_t tag_manifest_read(Storage* storage, uint16_t first, TagManifestEntry* entries, uint16_t count);
+
+// Replace the entry with the same name, or add it
+bool tag_manifest_put(Storage* storage, const TagManifestEntry* entry);
+
+// Most entries tag_manifest_put_many() takes
+#define TAG_MANIFEST_PUT_MAX 8
+
+// tag_manifest_put() for up to TAG_MANIFEST_PUT_MAX entries, with one pass
+// over the manifest and one header write
+bool tag_manifest_put_many(Storage* storage, const TagManifestEntry* entries, uint8_t count);
+
+// Remove the entry with this name, the last entry takes its place
+bool tag_manifest_remove(Storage* storage, const char* name);
+
+// Start a new, empty manifest. Entries are added with tag_manifest_append()
+// and the header is written by tag_manifest_finish().
+File* tag_manifest_create(Storage* storage, TagManifestHeader* header);
+bool tag_manifest_append(File* file, TagManifestHeader* header, const TagManifestEntry* entry);
+bool tag_manifest_finish(File* file, const TagManifestHeader* header);
+
+// ============================================
+// Pages
+// ============================================
+// The Saved Tags list holds one page at a time, so its RAM does not depend
+// on the number of tags. SavedTagsSortNone pages are read straight from
+// their offset. Sorted pages take one pass over the manifest, keeping the
+// page's entries in a buffer the size of the page.
+#define TAG_MANIFEST_PAGE_SIZE 16
+
+struct TagManifestPage {
+    TagManifestCursor items[TAG_MANIFEST_PAGE_SIZE + 1];  // The page in order, then the next page's first entry
+    uint8_t count;
+    bool has_next;  // items[count] is valid
+    uint16_t first;  // Position of items[0] in the list, entries before it mean a previous page
+    uint16_t total;  // Entries in the manifest
+};
+
+// Page of the entries from start on, the first page if start is NULL
+void tag_manifest_page_from(
+    Storage* storage,
+    SavedTagsSort sort,
+    const TagManifestCursor* start,
+    TagManifestPage* page);
+
+// Page of the entries just before start
+void tag_manifest_page_before(
+    Storage* storage,
+    SavedTagsSort sort,
+    const TagManifestCursor* start,
+    TagManifestPage* page);
@@ -5,6 +5,18 @@
  */
 
 #include "tag_storage.h"
+#include "btag_format.h"
+#include "btag_text.h"
+#include "storage_worker.h"
+#include "tag_db.h"
+#include "tag_manifest.h"
+
+// Tag files are read through a buffer this size, v1 text a line at a time
+#define TAG_READ_BUFFER 128
+
+// Added to a tag file's name while a save of it is written
+#define TAG_TEMP_EXTENSION ".tmp"
+#define TAG_TEMP_NAME_SIZE (sizeof(((TagManifestEntry*)0)->name) + sizeof(TAG_TEMP_EXTENSION))
 
 bool ensure_storage_dir(Storage* storage) {
     if(!storage_dir_exists(storage, BAMBU_TAGGER_FOLDER)) {
@@ -13,191 +25,196 @@ bool ensure_storage_dir(Storage* storage) {
     return true;
 }
 
-bool save_tag_to_file(App* app) {
-    if(!ensure_storage_dir(app->storage)) {
-        FURI_LOG_E(TAG, "Failed to create storage directory");
-        return false;
+// Name of a saved tag, the full UID in hex so 7-byte UIDs sharing their
+// first 4 bytes don't collide
+static void tag_name(const uint8_t* uid, uint8_t uid_len, char* name, size_t size) {
+    size_t pos = 0;
+    for(uint8_t i = 0; i < uid_len; i++) {
+        pos += snprintf(name + pos, size - pos, "%02X", uid[i]);
     }
+    snprintf(name + pos, size - pos, "%s", BAMBU_TAGGER_EXTENSION);
+}
 
-    // Generate filename from UID
-    FuriString* path = furi_string_alloc();
-    furi_string_printf(
-        path,
-        "%s/%02X%02X%02X%02X%s",
-        BAMBU_TAGGER_FOLDER,
-        app->tag_data.uid[0],
-        app->tag_data.uid[1],
-        app->tag_data.uid[2],
-        app->tag_data.uid[3],
-        BAMBU_TAGGER_EXTENSION);
+#ifdef BAMBU_TAG_DB
+// Saved tags are named after the UID in hex, path is optional. The tag
+// database has no per-tag files but lists its tags under the same names, so
+// this reads back any UID tag_name() writes.
+static bool uid_from_name(const char* path, uint8_t* uid, uint8_t* uid_len) {
+    const char* name = strrchr(path, '/');
+    name = name ? name + 1 : path;
+
+    size_t digits = strcspn(name, ".");
+    if(digits == 0 || digits % 2 != 0 || digits / 2 > BAMBU_UID_MAX_LEN) return false;
+    for(size_t i = 0; i < digits / 2; i++) {
+        unsigned int byte;
+        if(sscanf(name + i * 2, "%2X", &byte) != 1) return false;
+        uid[i] = byte;
+    }
+    *uid_len = digits / 2;
+    return true;
+}
+#else
+// Whether the file at path holds exactly the size bytes of a checked record
+static bool check_tag_file(Storage* storage, const char* path, size_t size, BtagRecord* scratch) {
+    File* file = storage_file_alloc(storage);
+    bool success = storage_file_open(file, path, FSAM_READ, FSOM_OPEN_EXISTING) &&
+                   storage_file_size(file) == size &&
+                   storage_file_read(file, scratch, size) == size &&
+                   btag_record_check(scratch, size);
+    storage_file_close(file);
+    storage_file_free(file);
+    return success;
+}
 
-    File* file = storage_file_alloc(app->storage);
+// Write a sealed record to path through a temp file, which is read back and
+// checked before it replaces path. Cut short at any point, the previous tag
+// stays in place or recover_saved_tags() finishes the save.
+static bool save_record_to_path(
+    Storage* storage,
+    const BtagRecord* record,
+    size_t size,
+    const char* path,
+    BtagRecord* scratch) {
+    FuriString* temp = furi_string_alloc();
+    File* file = storage_file_alloc(storage);
     bool success = false;
 
-    if(storage_file_open(file, furi_string_get_cstr(path), FSAM_WRITE, FSOM_CREATE_ALWAYS)) {
-        FuriString* data = furi_string_alloc();
-
-        // Write header
-        furi_string_printf(data, "Filetype: Bambu Tag\nVersion: 1\n");
-
-        // Write UID
-        furi_string_cat_printf(
-            data,
-            "UID: %02X %02X %02X %02X\n",
-            app->tag_data.uid[0],
-            app->tag_data.uid[1],
-            app->tag_data.uid[2],
-            app->tag_data.uid[3]);
-        furi_string_cat_printf(data, "UID_len: %d\n", app->tag_data.uid_len);
-
-        // Write block data as hex
-        furi_string_cat(data, "Block_1:");
-        for(int i = 0; i < 16; i++) {
-            furi_string_cat_printf(data, " %02X", app->read_data.block1[i]);
-        }
-        furi_string_cat(data, "\n");
-
-        furi_string_cat(data, "Block_2:");
-        for(int i = 0; i < 16; i++) {
-            furi_string_cat_printf(data, " %02X", app->read_data.block2[i]);
-        }
-        furi_string_cat(data, "\n");
-
-        furi_string_cat(data, "Block_4:");
-        for(int i = 0; i < 16; i++) {
-            furi_string_cat_printf(data, " %02X", app->read_data.block4[i]);
-        }
-        furi_string_cat(data, "\n");
+    furi_string_printf(temp, "%s%s", path, TAG_TEMP_EXTENSION);
+    if(storage_file_open(file, furi_string_get_cstr(temp), FSAM_WRITE, FSOM_CREATE_ALWAYS)) {
+        success = storage_file_write(file, record, size) == size && storage_file_sync(file);
+    }
+    storage_file_close(file);
+    storage_file_free(file);
 
-        furi_string_cat(data, "Block_5:");
-        for(int i = 0; i < 16; i++) {
-            furi_string_cat_printf(data, " %02X", app->read_data.block5[i]);
-        }
-        furi_string_cat(data, "\n");
+    success = success && check_tag_file(storage, furi_string_get_cstr(temp), size, scratch);
+    if(success) {
+        storage_simply_remove(storage, path);
+        success = storage_common_rename(storage, furi_string_get_cstr(temp), path) == FSE_OK;
+    }
 
-        furi_string_cat(data, "Block_6:");
-        for(int i = 0; i < 16; i++) {
-            furi_string_cat_printf(data, " %02X", app->read_data.block6[i]);
-        }
-        furi_string_cat(data, "\n");
+    if(success) {
+        FURI_LOG_I(TAG, "Tag saved to %s", path);
+    } else {
+        storage_simply_remove(storage, furi_string_get_cstr(temp));
+        FURI_LOG_E(TAG, "Failed to write %s", path);
+    }
+    furi_string_free(temp);
+    return success;
+}
+#endif
 
-        if(storage_file_write(file, furi_string_get_cstr(data), furi_string_size(data)) ==
-           furi_string_size(data)) {
-            success = true;
-            FURI_LOG_I(TAG, "Tag saved to %s", furi_string_get_cstr(path));
-        }
+uint8_t save_tag_records(Storage* storage, TagSave* saves, uint8_t count) {
+    furi_check(count <= TAG_MANIFEST_PUT_MAX);
+    if(!ensure_storage_dir(storage)) {
+        FURI_LOG_E(TAG, "Failed to create storage directory");
+        return 0;
+    }
 
-        furi_string_free(data);
+    TagManifestEntry* entries = malloc(count * sizeof(TagManifestEntry));
+    uint8_t saved = 0;
+#ifndef BAMBU_TAG_DB
+    FuriString* path = furi_string_alloc();
+    BtagRecord* scratch = malloc(sizeof(BtagRecord));
+#endif
+
+    for(uint8_t i = 0; i < count; i++) {
+        char name[sizeof(((TagManifestEntry*)0)->name)];
+        tag_name(saves[i].record->header.uid, saves[i].record->header.uid_len, name, sizeof(name));
+
+#ifdef BAMBU_TAG_DB
+        // The log is append-only, a save cut short leaves a torn tail that is dropped
+        saves[i].saved = tag_db_save(storage, saves[i].record, saves[i].size);
+#else
+        furi_string_printf(path, "%s/%s", BAMBU_TAGGER_FOLDER, name);
+        saves[i].saved = save_record_to_path(
+            storage, saves[i].record, saves[i].size, furi_string_get_cstr(path), scratch);
+#endif
+        if(saves[i].saved) tag_manifest_entry_from_record(saves[i].record, name, &entries[saved++]);
     }
 
-    storage_file_close(file);
-    storage_file_free(file);
+    // One manifest update for the whole group
+    if(saved > 0) tag_manifest_put_many(storage, entries, saved);
+
+#ifndef BAMBU_TAG_DB
+    free(scratch);
     furi_string_free(path);
+#endif
+    free(entries);
+    return saved;
+}
+
+bool save_tag_record(Storage* storage, const BtagRecord* record, size_t size) {
+    TagSave save = {.record = record, .size = size};
+    return save_tag_records(storage, &save, 1) == 1;
+}
+
+// Blocks of a v1 file go into the record in block order, as in a v2 file
+static void add_v1_block(uint8_t block, const uint8_t* data, void* context) {
+    // Blocks past the end of a 1K tag are dropped
+    if(block < WRITE_BLOCK_COUNT) btag_record_set_block(context, block, data);
+}
 
+// Parse a v1 text file through the read buffer, which holds its first size
+// bytes. Files from before the full UID was kept have 4 UID bytes.
+static bool load_tag_v1(File* file, uint64_t file_size, char* buffer, size_t size, BtagRecord* record) {
+    BtagHeader* header = &record->header;
+    BtagTextParser parser;
+    uint64_t total = 0;
+
+    memset(header, 0, sizeof(BtagHeader));
+    btag_text_init(&parser, add_v1_block, record);
+    while(size > 0 && btag_text_feed(&parser, buffer, size)) {
+        total += size;
+        size = storage_file_read(file, buffer, TAG_READ_BUFFER);
+    }
+
+    bool success = btag_text_finish(&parser) && total == file_size &&
+                   parser.uid_len <= sizeof(((TagProgramData*)0)->uid);
+    if(success) {
+        header->magic = BTAG_MAGIC;
+        header->version = BTAG_VERSION;
+        header->flags = parser.has_dump ? BTAG_FLAG_DUMP : 0;
+        header->failed_sectors = parser.failed_sectors;
+        header->uid_len = parser.uid_len;
+        memcpy(header->uid, parser.uid, parser.uid_bytes);
+        btag_record_seal(record);
+    } else if(parser.failed) {
+        FURI_LOG_E(TAG, "Malformed line %u", parser.line);
+    }
     return success;
 }
 
-bool load_tag_from_file(App* app, const char* path) {
-    File* file = storage_file_alloc(app->storage);
+// Read the rest of a v2 record after the size bytes already in buffer
+static bool load_tag_v2(File* file, uint64_t file_size, const char* buffer, size_t size, BtagRecord* record) {
+    if(file_size > sizeof(BtagRecord)) return false;
+
+    size_t rest = file_size - size;
+    memcpy(record, buffer, size);
+    return storage_file_read(file, (uint8_t*)record + size, rest) == rest &&
+           btag_record_check(record, file_size);
+}
+
+// Load a v2 or v1 tag file as a sealed v2 record
+static bool load_tag_file(Storage* storage, const char* path, BtagRecord* record) {
+    File* file = storage_file_alloc(storage);
     bool success = false;
 
     if(storage_file_open(file, path, FSAM_READ, FSOM_OPEN_EXISTING)) {
         uint64_t file_size = storage_file_size(file);
-        if(file_size > 0 && file_size < 4096) {
-            char* buffer = malloc(file_size + 1);
-            if(storage_file_read(file, buffer, file_size) == file_size) {
-                buffer[file_size] = '\0';
-
-                // Parse UID
-                char* uid_line = strstr(buffer, "UID:");
-                if(uid_line) {
-                    unsigned int u0, u1, u2, u3;
-                    if(sscanf(uid_line, "UID: %02X %02X %02X %02X", &u0, &u1, &u2, &u3) == 4) {
-                        app->tag_data.uid[0] = u0;
-                        app->tag_data.uid[1] = u1;
-                        app->tag_data.uid[2] = u2;
-                        app->tag_data.uid[3] = u3;
-                    }
-                }
-
-                // Parse UID length
-                char* uid_len_line = strstr(buffer, "UID_len:");
-                if(uid_len_line) {
-                    int len;
-                    if(sscanf(uid_len_line, "UID_len: %d", &len) == 1) {
-                        app->tag_data.uid_len = len;
-                    }
-                }
-
-                // Parse blocks
-                char* block1_line = strstr(buffer, "Block_1:");
-                if(block1_line) {
-                    unsigned int b[16];
-                    if(sscanf(
-                           block1_line,
-                           "Block_1: %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X",
-                           &b[0], &b[1], &b[2], &b[3], &b[4], &b[5], &b[6], &b[7],
-                           &b[8], &b[9], &b[10], &b[11], &b[12], &b[13], &b[14], &b[15]) == 16) {
-                        for(int i = 0; i < 16; i++) app->read_data.block1[i] = b[i];
-                    }
-                }
-
-                char* block2_line = strstr(buffer, "Block_2:");
-                if(block2_line) {
-                    unsigned int b[16];
-                    if(sscanf(
-                           block2_line,
-                           "Block_2: %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X",
-                           &b[0], &b[1], &b[2], &b[3], &b[4], &b[5], &b[6], &b[7],
-                           &b[8], &b[9], &b[10], &b[11], &b[12], &b[13], &b[14], &b[15]) == 16) {
-                        for(int i = 0; i < 16; i++) app->read_data.block2[i] = b[i];
-                    }
-                }
-
-                char* block4_line = strstr(buffer, "Block_4:");
-                if(block4_line) {
-                    unsigned int b[16];
-                    if(sscanf(
-                           block4_line,
-                           "Block_4: %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X",
-                           &b[0], &b[1], &b[2], &b[3], &b[4], &b[5], &b[6], &b[7],
-                           &b[8], &b[9], &b[10], &b[11], &b[12], &b[13], &b[14], &b[15]) == 16) {
-                        for(int i = 0; i < 16; i++) app->read_data.block4[i] = b[i];
-                    }
-                }
-
-                char* block5_line = strstr(buffer, "Block_5:");
-                if(block5_line) {
-                    unsigned int b[16];
-                    if(sscanf(
-                           block5_line,
-                           "Block_5: %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X",
-                           &b[0], &b[1], &b[2], &b[3], &b[4], &b[5], &b[6], &b[7],
-                           &b[8], &b[9], &b[10], &b[11], &b[12], &b[13], &b[14], &b[15]) == 16) {
-                        for(int i = 0; i < 16; i++) app->read_data.block5[i] = b[i];
-                    }
-                }
-
-                // Block 6 (manufacturer) - optional for backward compatibility
-                // Initialize to zeros first (will display as "Generic" if not present)
-                memset(app->read_data.block6, 0, 16);
-                char* block6_line = strstr(buffer, "Block_6:");
-                if(block6_line) {
-                    unsigned int b[16];
-                    if(sscanf(
-                           block6_line,
-                           "Block_6: %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X",
-                           &b[0], &b[1], &b[2], &b[3], &b[4], &b[5], &b[6], &b[7],
-                           &b[8], &b[9], &b[10], &b[11], &b[12], &b[13], &b[14], &b[15]) == 16) {
-                        for(int i = 0; i < 16; i++) app->read_data.block6[i] = b[i];
-                    }
-                }
-
-                app->read_data.valid = true;
-                success = true;
+        char buffer[TAG_READ_BUFFER];
+        size_t size = storage_file_read(file, buffer, sizeof(buffer));
+        uint32_t magic = 0;
+        if(size >= sizeof(magic)) memcpy(&magic, buffer, sizeof(magic));
+
+        if(size > 0) {
+            success = magic == BTAG_MAGIC ?
+                          load_tag_v2(file, file_size, buffer, size, record) :
+                          load_tag_v1(file, file_size, buffer, size, record);
+            if(success) {
                 FURI_LOG_I(TAG, "Tag loaded from %s", path);
+            } else {
+                FURI_LOG_E(TAG, "Corrupt tag file %s", path);
             }
-            free(buffer);
         }
     }
 
@@ -207,44 +224,385 @@ bool load_tag_from_file(App* app, const char* path) {
     return success;
 }
 
-void load_saved_tags_list(App* app) {
-    app->saved_tags_count = 0;
+bool load_tag_record(Storage* storage, const char* path, BtagRecord* record) {
+#ifdef BAMBU_TAG_DB
+    uint8_t uid[BAMBU_UID_MAX_LEN];
+    uint8_t uid_len;
+    return uid_from_name(path, uid, &uid_len) && tag_db_load(storage, uid, uid_len, record);
+#else
+    return load_tag_file(storage, path, record);
+#endif
+}
+
+
+typedef void (*SavedTagNameCallback)(App* app, const char* name, void* context);
 
+// Call back for every file in the folder whose name ends in extension.
+// Names whose tag name (up to BAMBU_TAGGER_EXTENSION) is too long for the
+// manifest are skipped.
+static void for_each_file(
+    App* app,
+    const char* extension,
+    SavedTagNameCallback callback,
+    void* context) {
     File* dir = storage_file_alloc(app->storage);
     if(storage_dir_open(dir, BAMBU_TAGGER_FOLDER)) {
         FileInfo info;
         char name[64];
-
-        while(storage_dir_read(dir, &info, name, sizeof(name)) && app->saved_tags_count < MAX_SAVED_TAGS) {
-            if(!(info.flags & FSF_DIRECTORY)) {
-                // Check extension
-                size_t len = strlen(name);
-                size_t ext_len = strlen(BAMBU_TAGGER_EXTENSION);
-                if(len > ext_len && strcmp(name + len - ext_len, BAMBU_TAGGER_EXTENSION) == 0) {
-                    strncpy(app->saved_tags[app->saved_tags_count], name, 63);
-                    app->saved_tags[app->saved_tags_count][63] = '\0';
-                    app->saved_tags_count++;
-                }
+        size_t ext_len = strlen(extension);
+        size_t tag_ext_len = strlen(BAMBU_TAGGER_EXTENSION);
+
+        while(storage_dir_read(dir, &info, name, sizeof(name))) {
+            size_t len = strlen(name);
+            if(!(info.flags & FSF_DIRECTORY) && len > ext_len &&
+               len - ext_len + tag_ext_len < sizeof(((TagManifestEntry*)0)->name) &&
+               strcmp(name + len - ext_len, extension) == 0) {
+                callback(app, name, context);
             }
         }
     }
     storage_dir_close(dir);
     storage_file_free(dir);
+}
+
+// Call back for every .btag file in the folder
+static void for_each_tag_file(App* app, SavedTagNameCallback callback, void* context) {
+    for_each_file(app, BAMBU_TAGGER_EXTENSION, callback, context);
+}
+
+#ifdef BAMBU_TAG_DB
+typedef struct {
+    App* app;
+    SavedTagNameCallback callback;
+    void* context;
+} DbListContext;
+
+static void list_db_tag(const uint8_t* uid, uint8_t uid_len, void* context) {
+    DbListContext* list = context;
+    char name[sizeof(((TagManifestEntry*)0)->name)];
+
+    tag_name(uid, uid_len, name, sizeof(name));
+    list->callback(list->app, name, list->context);
+}
+#endif
+
+// Call back for every saved tag, from the tag database index or the folder
+static void for_each_saved_tag(App* app, SavedTagNameCallback callback, void* context) {
+#ifdef BAMBU_TAG_DB
+    DbListContext list = {.app = app, .callback = callback, .context = context};
+    tag_db_list(app->storage, list_db_tag, &list);
+#else
+    for_each_tag_file(app, callback, context);
+#endif
+}
+
+// Add the names of the files to convert to a newline separated list. Files
+// are only read here, the folder is not changed while it is open.
+static void collect_tag_file(App* app, const char* name, void* context) {
+    FuriString* names = context;
+
+#ifndef BAMBU_TAG_DB
+    // Only the magic is needed to skip files that are v2 already
+    FuriString* path = furi_string_alloc();
+    File* file = storage_file_alloc(app->storage);
+    uint32_t magic = 0;
+    furi_string_printf(path, "%s/%s", BAMBU_TAGGER_FOLDER, name);
+    if(storage_file_open(file, furi_string_get_cstr(path), FSAM_READ, FSOM_OPEN_EXISTING)) {
+        storage_file_read(file, &magic, sizeof(magic));
+    }
+    storage_file_close(file);
+    storage_file_free(file);
+    furi_string_free(path);
+    if(magic == BTAG_MAGIC) return;
+#else
+    UNUSED(app);
+#endif
+    furi_string_cat_printf(names, "%s\n", name);
+}
+
+static bool migrate_tag_file(App* app, const char* name) {
+    FuriString* path = furi_string_alloc();
+    furi_string_printf(path, "%s/%s", BAMBU_TAGGER_FOLDER, name);
+    BtagRecord* record = malloc(sizeof(BtagRecord));
+    bool success = load_tag_file(app->storage, furi_string_get_cstr(path), record);
+
+#ifdef BAMBU_TAG_DB
+    // Files of either version move into the database
+    success = success && save_tag_record(app->storage, record, btag_record_size(&record->header));
+    if(success) storage_simply_remove(app->storage, furi_string_get_cstr(path));
+#else
+    // Rewritten under the same name, so nothing shows up twice in the list
+    if(success) {
+        BtagRecord* scratch = malloc(sizeof(BtagRecord));
+        success = save_record_to_path(
+            app->storage,
+            record,
+            btag_record_size(&record->header),
+            furi_string_get_cstr(path),
+            scratch);
+        free(scratch);
+    }
+#endif
+    free(record);
+    furi_string_free(path);
+    return success;
+}
+
+uint16_t migrate_saved_tags(App* app) {
+    FuriString* names = furi_string_alloc();
+    char name[sizeof(((TagManifestEntry*)0)->name)];
+    uint16_t migrated = 0;
+
+    // Every name is listed before the first file is rewritten or removed
+    for_each_tag_file(app, collect_tag_file, names);
+    for(const char* next = furi_string_get_cstr(names); *next != '\0';) {
+        const char* end = strchr(next, '\n');
+        size_t len = end - next;
+        memcpy(name, next, len);
+        name[len] = '\0';
+        if(migrate_tag_file(app, name)) migrated++;
+        next = end + 1;
+    }
+    furi_string_free(names);
+    if(migrated > 0) app->saved_tags_synced = false;
+
+    FURI_LOG_I(TAG, "Migrated %u tag files", migrated);
+    return migrated;
+}
+
+// ============================================
+// Recovery
+// ============================================
+static void find_temp_file(App* app, const char* name, void* context) {
+    char* found = context;
+    UNUSED(app);
+
+    if(found[0] == '\0') snprintf(found, TAG_TEMP_NAME_SIZE, "%s", name);
+}
+
+uint16_t recover_saved_tags(App* app) {
+    char name[TAG_TEMP_NAME_SIZE];
+    FuriString* temp = furi_string_alloc();
+    FuriString* path = furi_string_alloc();
+    BtagRecord* record = malloc(sizeof(BtagRecord));
+    uint16_t recovered = 0;
+
+    // One temp file per pass, the folder is not changed while it is open
+    for(;;) {
+        name[0] = '\0';
+        for_each_file(app, BAMBU_TAGGER_EXTENSION TAG_TEMP_EXTENSION, find_temp_file, name);
+        if(name[0] == '\0') break;
+
+        furi_string_printf(temp, "%s/%s", BAMBU_TAGGER_FOLDER, name);
+        name[strlen(name) - strlen(TAG_TEMP_EXTENSION)] = '\0';
+        furi_string_printf(path, "%s/%s", BAMBU_TAGGER_FOLDER, name);
+
+        // Checked before anything was renamed, so a temp file that loads is the
+        // newest copy of its tag. One cut short is dropped, the tag it was to
+        // replace is still whole.
+        if(load_tag_file(app->storage, furi_string_get_cstr(temp), record)) {
+            storage_simply_remove(app->storage, furi_string_get_cstr(path));
+            if(storage_common_rename(
+                   app->storage, furi_string_get_cstr(temp), furi_string_get_cstr(path)) != FSE_OK) {
+                FURI_LOG_E(TAG, "Failed to recover %s", name);
+                break;
+            }
+#ifndef BAMBU_TAG_DB
+            // Tag database builds list the file once it is converted
+            TagManifestEntry entry;
+            tag_manifest_entry_from_record(record, name, &entry);
+            tag_manifest_put(app->storage, &entry);
+#endif
+            recovered++;
+        } else if(!storage_simply_remove(app->storage, furi_string_get_cstr(temp))) {
+            break;
+        }
+    }
+
+    if(recovered > 0) FURI_LOG_W(TAG, "Recovered %u interrupted saves", recovered);
+    free(record);
+    furi_string_free(path);
+    furi_string_free(temp);
+    return recovered;
+}
+
+// ============================================
+// Manifest
+// ============================================
+typedef struct {
+    File* file;
+    TagManifestHeader header;
+    BtagRecord* record;  // Scratch for loading tag files
+} ManifestRebuild;
+
+static void count_saved_tag(App* app, const char* name, void* context) {
+    TagManifestHeader* expected = context;
+    UNUSED(app);
+
+    expected->count++;
+    expected->names_hash ^= tag_manifest_name_hash(name);
+}
+
+#ifdef BAMBU_TAG_DB
+static void rebuild_db_entry(const BtagRecord* record, void* context) {
+    ManifestRebuild* rebuild = context;
+    char name[sizeof(((TagManifestEntry*)0)->name)];
+    TagManifestEntry entry;
+
+    tag_name(record->header.uid, record->header.uid_len, name, sizeof(name));
+    tag_manifest_entry_from_record(record, name, &entry);
+    tag_manifest_append(rebuild->file, &rebuild->header, &entry);
+}
+#else
+static void rebuild_file_entry(App* app, const char* name, void* context) {
+    ManifestRebuild* rebuild = context;
+    FuriString* path = furi_string_alloc();
+    TagManifestEntry entry;
+
+    // A file that does not load is listed by name, so it can still be deleted
+    furi_string_printf(path, "%s/%s", BAMBU_TAGGER_FOLDER, name);
+    if(load_tag_file(app->storage, furi_string_get_cstr(path), rebuild->record)) {
+        tag_manifest_entry_from_record(rebuild->record, name, &entry);
+    } else {
+        memset(&entry, 0, sizeof(entry));
+        snprintf(entry.name, sizeof(entry.name), "%s", name);
+    }
+    tag_manifest_append(rebuild->file, &rebuild->header, &entry);
+    furi_string_free(path);
+}
+#endif
+
+// Build the manifest from every saved tag, opening each one
+static void rebuild_manifest(App* app) {
+    ManifestRebuild rebuild = {0};
+
+    rebuild.file = tag_manifest_create(app->storage, &rebuild.header);
+    if(!rebuild.file) return;
+#ifdef BAMBU_TAG_DB
+    tag_db_for_each(app->storage, rebuild_db_entry, &rebuild);
+#else
+    rebuild.record = malloc(sizeof(BtagRecord));
+    for_each_tag_file(app, rebuild_file_entry, &rebuild);
+    free(rebuild.record);
+#endif
+    tag_manifest_finish(rebuild.file, &rebuild.header);
+
+    FURI_LOG_I(TAG, "Manifest rebuilt, %u tags", rebuild.header.count);
+}
+
+void sync_saved_tags(App* app) {
+    TagManifestHeader header;
+    TagManifestHeader expected = {0};
 
-    FURI_LOG_I(TAG, "Found %d saved tags", app->saved_tags_count);
+    // Saves and deletes keep the manifest up to date from then on
+    if(app->saved_tags_synced) return;
+
+    // Tags added or removed behind the app's back change the count or the
+    // name hash. Listing the names opens no tags.
+    for_each_saved_tag(app, count_saved_tag, &expected);
+    if(!tag_manifest_read_header(app->storage, &header) || header.count != expected.count ||
+       header.names_hash != expected.names_hash) {
+        rebuild_manifest(app);
+    }
+    app->saved_tags_synced = true;
+
+    FURI_LOG_I(TAG, "Found %u saved tags", expected.count);
 }
 
-bool delete_saved_tag(App* app, const char* filename) {
+bool delete_saved_tag(Storage* storage, const char* filename) {
+#ifdef BAMBU_TAG_DB
+    uint8_t uid[BAMBU_UID_MAX_LEN];
+    uint8_t uid_len;
+    bool success = uid_from_name(filename, uid, &uid_len) &&
+                   tag_db_delete(storage, uid, uid_len);
+#else
     FuriString* path = furi_string_alloc();
     furi_string_printf(path, "%s/%s", BAMBU_TAGGER_FOLDER, filename);
+    bool success = storage_simply_remove(storage, furi_string_get_cstr(path));
+    furi_string_free(path);
+#endif
 
-    bool success = storage_simply_remove(app->storage, furi_string_get_cstr(path));
     if(success) {
+        tag_manifest_remove(storage, filename);
         FURI_LOG_I(TAG, "Deleted tag: %s", filename);
     } else {
         FURI_LOG_E(TAG, "Failed to delete tag: %s", filename);
     }
-
-    furi_string_free(path);
     return success;
 }
+
+// Hand the buffered records to the storage worker, written in one storage
+// call while the next tags are read
+static void inventory_log_flush(App* app) {
+    InventoryState* inventory = app->inventory;
+
+    if(furi_string_size(inventory->log_buffer) > 0) {
+        storage_worker_append(app->storage_worker, inventory->log_file, inventory->log_buffer);
+        inventory->log_buffer = furi_string_alloc();
+    }
+}
+
+bool inventory_log_open_file(Storage* storage, File* file) {
+    if(!ensure_storage_dir(storage)) {
+        FURI_LOG_E(TAG, "Failed to create storage directory");
+        return false;
+    }
+    if(!storage_file_open(file, INVENTORY_LOG_PATH, FSAM_READ_WRITE, FSOM_OPEN_APPEND)) {
+        FURI_LOG_E(TAG, "Failed to open %s", INVENTORY_LOG_PATH);
+        return false;
+    }
+
+    uint64_t size = storage_file_size(file);
+    const char* start = NULL;
+    char last = '\n';
+    if(size == 0) {
+        start = "UID,Type,Detail,Color,Weight\n";
+    } else if(
+        storage_file_seek(file, size - 1, true) && storage_file_read(file, &last, 1) == 1 &&
+        last != '\n') {
+        // A sweep cut short mid-record, the partial line is ended on its own
+        start = "\n";
+    }
+    return start == NULL || storage_file_write(file, start, strlen(start)) == strlen(start);
+}
+
+void inventory_log_open(App* app) {
+    InventoryState* inventory = app->inventory;
+    inventory->log_buffer = furi_string_alloc();
+    inventory->log_file = storage_file_alloc(app->storage);
+    inventory->log_failed = false;
+    storage_worker_open_log(app->storage_worker, inventory->log_file);
+}
+
+void inventory_log_append(App* app, const char* filament_type, const char* detailed_type) {
+    InventoryState* inventory = app->inventory;
+    const ReadTagData* data = &app->read_data;
+
+    for(uint8_t i = 0; i < app->tag_data.uid_len; i++) {
+        furi_string_cat_printf(inventory->log_buffer, "%02X", app->tag_data.uid[i]);
+    }
+    furi_string_cat_printf(
+        inventory->log_buffer,
+        ",%s,%s,%02X%02X%02X,%d\n",
+        filament_type,
+        detailed_type,
+        data->block5[0],
+        data->block5[1],
+        data->block5[2],
+        data->block5[4] | (data->block5[5] << 8));
+
+    if(furi_string_size(inventory->log_buffer) >= INVENTORY_LOG_FLUSH_BYTES) {
+        inventory_log_flush(app);
+    }
+}
+
+void inventory_log_close(App* app) {
+    InventoryState* inventory = app->inventory;
+
+    inventory_log_flush(app);
+    // Closed after the appends still queued
+    storage_worker_close_log(app->storage_worker, inventory->log_file);
+    inventory->log_file = NULL;
+    furi_string_free(inventory->log_buffer);
+    inventory->log_buffer = NULL;
+}
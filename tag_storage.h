@@ -7,18 +7,55 @@
 #pragma once
 
 #include "bambu_tagger.h"
+#include "btag_format.h"
 
 // Ensure storage directory exists
 bool ensure_storage_dir(Storage* storage);
 
-// Save current tag data to file
-bool save_tag_to_file(App* app);
+// Save a sealed v2 record (see btag_record_from_app()) under the name of its
+// UID, and its manifest entry. A tag file is written to a temp file and
+// checked before it replaces the previous save.
+bool save_tag_record(Storage* storage, const BtagRecord* record, size_t size);
 
-// Load tag data from file
-bool load_tag_from_file(App* app, const char* path);
+typedef struct {
+    const BtagRecord* record;
+    size_t size;
+    bool saved;  // Set by save_tag_records()
+} TagSave;
 
-// Load list of saved tags
-void load_saved_tags_list(App* app);
+// save_tag_record() for up to TAG_MANIFEST_PUT_MAX records, with one
+// manifest update for all of them. Returns the number saved.
+uint8_t save_tag_records(Storage* storage, TagSave* saves, uint8_t count);
 
-// Delete a saved tag file
-bool delete_saved_tag(App* app, const char* filename);
+// Load a saved tag as a sealed v2 record, from a v2 or v1 file or the tag database
+bool load_tag_record(Storage* storage, const char* path, BtagRecord* record);
+
+// Rewrite every v1 file in the folder as v2, returns the number converted
+uint16_t migrate_saved_tags(App* app);
+
+// Finish or drop the saves an earlier run was cut short in, call before
+// anything else touches the folder. Returns the number finished.
+uint16_t recover_saved_tags(App* app);
+
+// Check the manifest against the saved tags once per run, rebuilding it if
+// tags were added or removed without going through
+// save_tag_record()/delete_saved_tag()
+void sync_saved_tags(App* app);
+
+// Delete a saved tag and its manifest entry
+bool delete_saved_tag(Storage* storage, const char* filename);
+
+// Start the inventory CSV log. The storage worker opens it, a failure posts
+// EventInventoryLogFailed and the records are dropped.
+void inventory_log_open(App* app);
+
+// Open file for appending to the inventory log, on the storage worker. Writes
+// the header to a new log and ends a partial last line.
+bool inventory_log_open_file(Storage* storage, File* file);
+
+// Buffer one CSV record for the tag in read_data, full buffers are written
+// by the storage worker
+void inventory_log_append(App* app, const char* filament_type, const char* detailed_type);
+
+// Hand the buffered records and the log to the storage worker to close
+void inventory_log_close(App* app);
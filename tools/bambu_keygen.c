@@ -0,0 +1,584 @@
+/**
+ * @file bambu_keygen.c
+ * @brief Host tool: Bambu sector keys for many UIDs at once
+ * @author Tai Nguyen <taiducnguyen.drexel@gmail.com>
+ */
+
+#include "keygen_x8.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// UIDs read, derived and written per round, keeps memory flat for any input size
+#define CHUNK_UIDS 65536
+#define MAX_THREADS 256
+
+typedef enum {
+    OutputDict,  // One key per line, the Flipper and Proxmark dictionary format
+    OutputCsv,   // uid,sector,key
+} OutputFormat;
+
+typedef struct {
+    const KeygenBackend* backend;
+    unsigned threads;
+    OutputFormat format;
+    FILE* out;
+} Options;
+
+typedef struct {
+    uint8_t (*uids)[BAMBU_UID_MAX_LEN];
+    uint8_t* uid_lens;
+    BambuKeys* keys;
+    size_t count;
+} Chunk;
+
+typedef struct {
+    const KeygenBackend* backend;
+    const Chunk* chunk;
+    size_t start;
+    size_t end;
+} Work;
+
+// ============================================
+// Helpers
+// ============================================
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+static uint64_t rng_next(void) {
+    // xorshift64*, good enough for test UIDs
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1Dull;
+}
+
+static void random_uid(uint8_t* uid, uint8_t* uid_len, uint8_t len) {
+    for(uint8_t i = 0; i < len; i++) uid[i] = rng_next() >> 56;
+    *uid_len = len;
+}
+
+static void chunk_alloc(Chunk* chunk, size_t capacity) {
+    chunk->uids = calloc(capacity, BAMBU_UID_MAX_LEN);
+    chunk->uid_lens = calloc(capacity, 1);
+    chunk->keys = calloc(capacity, sizeof(BambuKeys));
+    chunk->count = 0;
+    if(!chunk->uids || !chunk->uid_lens || !chunk->keys) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+}
+
+static void chunk_free(Chunk* chunk) {
+    free(chunk->uids);
+    free(chunk->uid_lens);
+    free(chunk->keys);
+}
+
+// ============================================
+// Parallel derivation
+// ============================================
+static void* derive_worker(void* context) {
+    Work* work = context;
+    const Chunk* chunk = work->chunk;
+
+    for(size_t i = work->start; i < work->end; i += KEYGEN_LANES) {
+        size_t count = work->end - i < KEYGEN_LANES ? work->end - i : KEYGEN_LANES;
+        keygen_derive(work->backend, &chunk->uids[i], &chunk->uid_lens[i], count, &chunk->keys[i]);
+    }
+    return NULL;
+}
+
+// Split the chunk in lane-aligned slices, one per thread
+static void derive_chunk(const KeygenBackend* backend, unsigned threads, const Chunk* chunk) {
+    pthread_t tids[MAX_THREADS];
+    Work work[MAX_THREADS];
+    size_t groups = (chunk->count + KEYGEN_LANES - 1) / KEYGEN_LANES;
+    size_t per_thread = (groups + threads - 1) / threads * KEYGEN_LANES;
+    unsigned started = 0;
+
+    for(unsigned t = 0; t < threads; t++) {
+        size_t start = t * per_thread;
+        if(start >= chunk->count) break;
+        work[t].backend = backend;
+        work[t].chunk = chunk;
+        work[t].start = start;
+        work[t].end = start + per_thread < chunk->count ? start + per_thread : chunk->count;
+        if(threads == 1) {
+            derive_worker(&work[t]);
+        } else if(pthread_create(&tids[t], NULL, derive_worker, &work[t]) == 0) {
+            started = t + 1;
+        } else {
+            // Out of threads, finish this slice here
+            derive_worker(&work[t]);
+        }
+    }
+    for(unsigned t = 0; t < started; t++) pthread_join(tids[t], NULL);
+}
+
+// ============================================
+// Generate
+// ============================================
+// Hex UID, separators ' ', ':' and '-' are ignored. False if not 4, 7 or 10 bytes.
+static bool parse_uid(const char* line, uint8_t* uid, uint8_t* uid_len) {
+    uint8_t len = 0;
+    int nibble = -1;
+
+    for(const char* p = line; *p && *p != '\n' && *p != '\r'; p++) {
+        if(*p == ' ' || *p == ':' || *p == '-' || *p == '\t') continue;
+        if(!isxdigit((unsigned char)*p)) return false;
+        int value = isdigit((unsigned char)*p) ? *p - '0' : (tolower((unsigned char)*p) - 'a' + 10);
+        if(nibble < 0) {
+            nibble = value;
+        } else {
+            if(len == BAMBU_UID_MAX_LEN) return false;
+            uid[len++] = (nibble << 4) | value;
+            nibble = -1;
+        }
+    }
+    if(nibble >= 0 || (len != 4 && len != 7 && len != 10)) return false;
+    *uid_len = len;
+    return true;
+}
+
+static void write_chunk(const Options* options, const Chunk* chunk) {
+    char uid_hex[BAMBU_UID_MAX_LEN * 2 + 1];
+
+    for(size_t i = 0; i < chunk->count; i++) {
+        for(uint8_t b = 0; b < chunk->uid_lens[i]; b++) {
+            sprintf(&uid_hex[b * 2], "%02X", chunk->uids[i][b]);
+        }
+        if(options->format == OutputDict) fprintf(options->out, "# UID %s\n", uid_hex);
+
+        for(int sector = 0; sector < BAMBU_NUM_SECTORS; sector++) {
+            const uint8_t* key = chunk->keys[i].keys[sector];
+            if(options->format == OutputCsv) fprintf(options->out, "%s,%d,", uid_hex, sector);
+            fprintf(
+                options->out,
+                "%02X%02X%02X%02X%02X%02X\n",
+                key[0],
+                key[1],
+                key[2],
+                key[3],
+                key[4],
+                key[5]);
+        }
+    }
+}
+
+static int cmd_generate(const Options* options, const char* path) {
+    FILE* in = stdin;
+    if(path && strcmp(path, "-") != 0) {
+        in = fopen(path, "r");
+        if(!in) {
+            fprintf(stderr, "%s: %s\n", path, strerror(errno));
+            return 1;
+        }
+    }
+
+    Chunk chunk;
+    chunk_alloc(&chunk, CHUNK_UIDS);
+    char line[256];
+    unsigned long line_no = 0;
+    unsigned long bad = 0;
+    unsigned long total = 0;
+    double start = now_seconds();
+
+    if(options->format == OutputDict) {
+        fprintf(options->out, "# Bambu Lab sector keys (key A), generated by bambu_keygen\n");
+    } else {
+        fprintf(options->out, "uid,sector,key\n");
+    }
+
+    bool eof = false;
+    while(!eof) {
+        chunk.count = 0;
+        while(chunk.count < CHUNK_UIDS) {
+            if(!fgets(line, sizeof(line), in)) {
+                eof = true;
+                break;
+            }
+            line_no++;
+
+            const char* p = line;
+            while(isspace((unsigned char)*p)) p++;
+            if(*p == '\0' || *p == '#') continue;
+
+            if(parse_uid(p, chunk.uids[chunk.count], &chunk.uid_lens[chunk.count])) {
+                chunk.count++;
+            } else {
+                fprintf(stderr, "line %lu: not a 4, 7 or 10 byte hex UID, skipped\n", line_no);
+                bad++;
+            }
+        }
+        derive_chunk(options->backend, options->threads, &chunk);
+        write_chunk(options, &chunk);
+        total += chunk.count;
+    }
+
+    double elapsed = now_seconds() - start;
+    fprintf(
+        stderr,
+        "%lu UIDs (%lu skipped) in %.3f s with %u threads, %s backend\n",
+        total,
+        bad,
+        elapsed,
+        options->threads,
+        options->backend->name);
+
+    chunk_free(&chunk);
+    if(in != stdin) fclose(in);
+    return 0;
+}
+
+// ============================================
+// Verify
+// ============================================
+static int cmd_verify(const Options* options, size_t count) {
+    const KeygenBackend* backends[] = {keygen_backend_scalar(), keygen_backend_avx2()};
+    Chunk chunk;
+    int failures = 0;
+
+    if(!bambu_crypto_self_test()) {
+        fprintf(stderr, "bambu_crypto_self_test() failed\n");
+        return 1;
+    }
+
+    chunk_alloc(&chunk, count);
+    for(size_t i = 0; i < count; i++) {
+        random_uid(chunk.uids[i], &chunk.uid_lens[i], (i % 2) ? 7 : 4);
+    }
+    chunk.count = count;
+
+    for(size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); b++) {
+        if(!backends[b]) {
+            printf("%-8s not available on this CPU\n", "avx2");
+            continue;
+        }
+
+        memset(chunk.keys, 0, count * sizeof(BambuKeys));
+        derive_chunk(backends[b], options->threads, &chunk);
+
+        size_t mismatches = 0;
+        for(size_t i = 0; i < count; i++) {
+            BambuKeys expected;
+            calculate_all_keys(chunk.uids[i], chunk.uid_lens[i], &expected);
+            if(memcmp(&expected, &chunk.keys[i], sizeof(BambuKeys)) != 0) mismatches++;
+        }
+        printf(
+            "%-8s %zu random UIDs: %s (%zu mismatches)\n",
+            backends[b]->name,
+            count,
+            mismatches ? "FAIL" : "ok",
+            mismatches);
+        if(mismatches) failures++;
+    }
+
+    chunk_free(&chunk);
+    return failures ? 1 : 0;
+}
+
+// ============================================
+// Known answers
+// ============================================
+// 96 key bytes (sectors 0-15, 6 bytes each) per UID, computed independently
+// with Python's hmac/hashlib from the HKDF description
+typedef struct {
+    const char* uid;
+    const char* keys;
+} KatVector;
+
+static const KatVector kat_vectors[] = {
+    {"00000000",
+     "F050DDF30252FD81B584EDAEBB59BE29F68F66AD8384A4F45E1E55057A058B0018851875E90364EC"
+     "D625450EAB6070AFBB32DC39A867B756FDB3F55A4EBCCA763A056A8D5A725913227BF308B972FCD7"
+     "D352A577BE66ED87C97BB9747BC57CE0"},
+    {"75886B1D",
+     "6E5B0EC6EF7C4CE96076285F0B0373BE835B906B2736C9580A7C3AA6E3CB9C357BA6842B6712858E"
+     "91964B3199AEA6566637239E0019B440E6CA11C089914A92BDF89CB8E022D296E82816DA2CF9D48F"
+     "ED3363205E6CA668CCC5D9805EEC7045"},
+    {"DEADBEEF",
+     "045C6DC690E9DAF05C224715141899C0B498375533C16DE8EA75FD5C2EC2F6AC7FD01B75E3D94B7C"
+     "914D3FEC6971DD785B57EFFC5D7A1B31535EFFE74C9BBD4EE19F8A5CD3180C9333BE1598F79E1A43"
+     "690778FAC192E145B71346CF8B20C176"},
+    {"FFFFFFFF",
+     "CC9D574932D4C7C7E6EC0B70621F9301891FB87FBB355DE412D3D0B26601F105EBBBCA00E5450A80"
+     "97951BAE45FDCE53EACA4D1BDCA6C396BDBD72CA0F6C08F8C393CE5453B0F808F458E2CDCC3D7D1B"
+     "65DBA42996B0DC5EACABEBA03992E45D"},
+    {"043A5C22916F80",
+     "72678EE6B9D7A81A0BB69079FA8E7B09AF66C7EC79E07092AAD4936BCD118AC4B72C83987BB8F192"
+     "1C5B0CF4FCDAE44530028173FE8931DA66EA0D9F2071D3806D673627EA53BD97AD29F8A7FEF3874F"
+     "89517A524DF10DAD41B052DB3FE8E247"},
+    {"04000000000000",
+     "F68645F0A3D4316239DDDDA5B824688E02776535156112F9339F4FE8157DC6FA37EA46481F119555"
+     "AC1A8615488C9E7CD55E2FF160699C470B54F0CA7FC93815B05F8EB5C09140FA42D1A2583DF2788E"
+     "BB444C027E015FC13F60325665F891B8"},
+    {"04FFFFFFFFFFFF",
+     "0B7D0F7E24C265A8A790C6E77BAA49798521D20E56C702B2DBF05610AE4B555208B9DF3B9AEE2B40"
+     "2132AC4A3680514ABF919430C0A2C2430DC0C56F1F224E06865A5C531DE8A634EBD218F699605F5D"
+     "8CAE7D552545B91621F1BA7BC7B21F67"},
+};
+
+static void hex_to_bytes(const char* hex, uint8_t* out, size_t len) {
+    for(size_t i = 0; i < len; i++) {
+        unsigned int value;
+        sscanf(&hex[i * 2], "%2X", &value);
+        out[i] = value;
+    }
+}
+
+// Report one implementation's keys against the expected ones
+static bool kat_check(const char* what, const char* uid, const BambuKeys* got, const BambuKeys* expected) {
+    bool ok = memcmp(got, expected, sizeof(BambuKeys)) == 0;
+    if(!ok) printf("  %s %s: FAIL\n", uid, what);
+    return ok;
+}
+
+static int cmd_kat(void) {
+    const KeygenBackend* backends[] = {keygen_backend_scalar(), keygen_backend_avx2()};
+    size_t count = sizeof(kat_vectors) / sizeof(kat_vectors[0]);
+    size_t failures = 0;
+
+    for(size_t v = 0; v < count; v++) {
+        const KatVector* vector = &kat_vectors[v];
+        uint8_t uid[BAMBU_UID_MAX_LEN];
+        uint8_t uid_len;
+        BambuKeys expected;
+        BambuKeys keys;
+        bool ok = parse_uid(vector->uid, uid, &uid_len);
+
+        hex_to_bytes(vector->keys, (uint8_t*)expected.keys, sizeof(BambuKeys));
+
+        calculate_all_keys(uid, uid_len, &keys);
+        ok &= kat_check("calculate_all_keys", vector->uid, &keys, &expected);
+
+        calculate_all_keys_mbedtls(uid, uid_len, &keys);
+        ok &= kat_check("calculate_all_keys_mbedtls", vector->uid, &keys, &expected);
+
+        // Incremental: the filament sectors first, then the rest on demand
+        BambuKdf kdf;
+        bambu_kdf_init(&kdf, uid, uid_len);
+        memset(&keys, 0, sizeof(keys));
+        bambu_kdf_get_keys(&kdf, 2, &keys);
+        bambu_kdf_get_keys(&kdf, BAMBU_NUM_SECTORS, &keys);
+        ok &= kat_check("bambu_kdf", vector->uid, &keys, &expected);
+
+        for(size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); b++) {
+            if(!backends[b]) continue;
+            keygen_derive(backends[b], (const uint8_t(*)[BAMBU_UID_MAX_LEN])uid, &uid_len, 1, &keys);
+            ok &= kat_check(backends[b]->name, vector->uid, &keys, &expected);
+        }
+
+        // Big-endian, the byte order MfClassicKey expects
+        for(int sector = 0; sector < BAMBU_NUM_SECTORS; sector++) {
+            uint64_t value = 0;
+            sscanf(&vector->keys[sector * BAMBU_KEY_LENGTH * 2], "%12" SCNx64, &value);
+            if(key_bytes_to_uint64(expected.keys[sector]) != value) {
+                printf("  %s key_bytes_to_uint64 sector %d: FAIL\n", vector->uid, sector);
+                ok = false;
+            }
+        }
+
+        printf("%-16s %d-byte UID: %s\n", vector->uid, uid_len, ok ? "ok" : "FAIL");
+        if(!ok) failures++;
+    }
+
+    printf("%zu of %zu vectors passed\n", count - failures, count);
+    return failures ? 1 : 0;
+}
+
+// ============================================
+// Benchmark
+// ============================================
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+// Time every call of a single-UID derivation, as the app does it
+static void bench_latency(
+    const char* name,
+    void (*derive)(const uint8_t*, size_t, BambuKeys*),
+    const Chunk* chunk,
+    uint64_t* samples) {
+    BambuKeys keys;
+    uint64_t total = 0;
+
+    for(size_t i = 0; i < chunk->count; i++) {
+        uint64_t start = now_ns();
+        derive(chunk->uids[i], chunk->uid_lens[i], &keys);
+        samples[i] = now_ns() - start;
+        total += samples[i];
+    }
+    qsort(samples, chunk->count, sizeof(uint64_t), compare_u64);
+
+    printf(
+        "%-26s %10.0f derivations/s, mean %6.0f ns, p99 %6llu ns, worst %8llu ns\n",
+        name,
+        chunk->count / (total * 1e-9),
+        (double)total / chunk->count,
+        (unsigned long long)samples[chunk->count * 99 / 100],
+        (unsigned long long)samples[chunk->count - 1]);
+}
+
+static void bench_backend(const KeygenBackend* backend, unsigned threads, const Chunk* chunk) {
+    double start = now_seconds();
+    derive_chunk(backend, threads, chunk);
+    double elapsed = now_seconds() - start;
+
+    double uids_per_s = chunk->count / elapsed;
+    printf(
+        "%-8s %3u threads: %10.0f UIDs/s, %11.0f keys/s, %11.0f keys/s/core\n",
+        backend->name,
+        threads,
+        uids_per_s,
+        uids_per_s * BAMBU_NUM_SECTORS,
+        uids_per_s * BAMBU_NUM_SECTORS / threads);
+}
+
+static int cmd_bench(const Options* options, size_t count) {
+    const KeygenBackend* backends[] = {keygen_backend_scalar(), keygen_backend_avx2()};
+    Chunk chunk;
+
+    chunk_alloc(&chunk, count);
+    for(size_t i = 0; i < count; i++) random_uid(chunk.uids[i], &chunk.uid_lens[i], 4);
+    chunk.count = count;
+
+    // One UID per call, mixed 4- and 7-byte UIDs
+    uint64_t* samples = malloc(count * sizeof(uint64_t));
+    if(!samples) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for(size_t i = 0; i < count; i++) {
+        random_uid(chunk.uids[i], &chunk.uid_lens[i], (i % 2) ? 7 : 4);
+    }
+    bench_latency("calculate_all_keys", calculate_all_keys, &chunk, samples);
+    bench_latency("calculate_all_keys_mbedtls", calculate_all_keys_mbedtls, &chunk, samples);
+    free(samples);
+
+    // Batches of KEYGEN_LANES UIDs
+    for(size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); b++) {
+        if(!backends[b]) continue;
+        bench_backend(backends[b], 1, &chunk);
+        if(options->threads > 1) bench_backend(backends[b], options->threads, &chunk);
+    }
+
+    chunk_free(&chunk);
+    return 0;
+}
+
+// ============================================
+// Main
+// ============================================
+static void usage(const char* argv0) {
+    fprintf(
+        stderr,
+        "usage: %s [options] [uid-file|-]   keys for one hex UID per line (stdin by default)\n"
+        "       %s [options] verify [count]  compare backends with calculate_all_keys()\n"
+        "       %s kat                       check known UID -> key vectors\n"
+        "       %s [options] bench [count]   latency per derivation, keys per second per core\n"
+        "options:\n"
+        "  -t N              worker threads (default: online CPUs)\n"
+        "  -o FILE           output file (default: stdout)\n"
+        "  -f dict|csv       dictionary for Flipper/Proxmark (default) or uid,sector,key\n"
+        "  -b scalar|avx2    SHA-256 backend (default: fastest available)\n",
+        argv0,
+        argv0,
+        argv0,
+        argv0);
+}
+
+int main(int argc, char** argv) {
+    Options options = {
+        .backend = keygen_backend_best(),
+        .threads = 0,
+        .format = OutputDict,
+        .out = stdout,
+    };
+    int opt;
+
+    while((opt = getopt(argc, argv, "t:o:f:b:h")) != -1) {
+        switch(opt) {
+        case 't':
+            options.threads = strtoul(optarg, NULL, 10);
+            break;
+        case 'o':
+            options.out = fopen(optarg, "w");
+            if(!options.out) {
+                fprintf(stderr, "%s: %s\n", optarg, strerror(errno));
+                return 1;
+            }
+            break;
+        case 'f':
+            if(strcmp(optarg, "dict") == 0) {
+                options.format = OutputDict;
+            } else if(strcmp(optarg, "csv") == 0) {
+                options.format = OutputCsv;
+            } else {
+                usage(argv[0]);
+                return 2;
+            }
+            break;
+        case 'b':
+            if(strcmp(optarg, "scalar") == 0) {
+                options.backend = keygen_backend_scalar();
+            } else if(strcmp(optarg, "avx2") == 0) {
+                options.backend = keygen_backend_avx2();
+                if(!options.backend) {
+                    fprintf(stderr, "this CPU has no AVX2\n");
+                    return 1;
+                }
+            } else {
+                usage(argv[0]);
+                return 2;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if(options.threads == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        options.threads = cpus > 0 ? (unsigned)cpus : 1;
+    }
+    if(options.threads > MAX_THREADS) options.threads = MAX_THREADS;
+
+    int result;
+    const char* command = optind < argc ? argv[optind] : NULL;
+    if(command && strcmp(command, "verify") == 0) {
+        size_t count = optind + 1 < argc ? strtoul(argv[optind + 1], NULL, 10) : 100000;
+        result = cmd_verify(&options, count ? count : 1);
+    } else if(command && strcmp(command, "kat") == 0) {
+        result = cmd_kat();
+    } else if(command && strcmp(command, "bench") == 0) {
+        size_t count = optind + 1 < argc ? strtoul(argv[optind + 1], NULL, 10) : 1000000;
+        result = cmd_bench(&options, count ? count : 1);
+    } else {
+        result = cmd_generate(&options, command);
+    }
+
+    if(options.out != stdout) fclose(options.out);
+    return result;
+}
@@ -0,0 +1,342 @@
+/**
+ * @file btag_parse.c
+ * @brief Host tool: benchmark and fuzz the v1 .btag text parser
+ * @author Tai Nguyen <taiducnguyen.drexel@gmail.com>
+ */
+
+#include "btag_text.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BLOCK_COUNT 64
+#define MAX_FILE 65536
+
+// The app reads tag files through a buffer this size (TAG_READ_BUFFER)
+#define APP_CHUNK 128
+
+// What a parse produced, compared between chunk sizes
+typedef struct {
+    bool ok;
+    uint16_t line;
+    uint8_t uid[BTAG_TEXT_UID_MAX];
+    uint8_t uid_bytes;
+    uint8_t uid_len;
+    bool has_dump;
+    uint16_t failed_sectors;
+    uint64_t block_mask;
+    uint8_t blocks[BLOCK_COUNT][16];
+} ParseResult;
+
+// ============================================
+// Helpers
+// ============================================
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static uint64_t rng_state = 0x9E3779B97F4A7C15ull;
+
+static uint64_t rng_next(void) {
+    // xorshift64*
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545F4914F6CDD1Dull;
+}
+
+static size_t read_file(const char* path, char* data, size_t capacity) {
+    FILE* file = fopen(path, "rb");
+    if(!file) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        exit(1);
+    }
+    size_t size = fread(data, 1, capacity, file);
+    fclose(file);
+    return size;
+}
+
+// ============================================
+// Parsers
+// ============================================
+static void keep_block(uint8_t block, const uint8_t* data, void* context) {
+    ParseResult* result = context;
+    if(block >= BLOCK_COUNT) return;
+    memcpy(result->blocks[block], data, 16);
+    result->block_mask |= 1ull << block;
+}
+
+// btag_text fed in chunks of chunk bytes, as the app reads the file
+static void parse_streaming(const char* data, size_t size, size_t chunk, ParseResult* result) {
+    BtagTextParser parser;
+
+    memset(result, 0, sizeof(ParseResult));
+    btag_text_init(&parser, keep_block, result);
+    for(size_t offset = 0; offset < size; offset += chunk) {
+        size_t part = size - offset < chunk ? size - offset : chunk;
+        if(!btag_text_feed(&parser, data + offset, part)) break;
+    }
+    result->ok = btag_text_finish(&parser);
+    result->line = parser.line;
+    memcpy(result->uid, parser.uid, sizeof(result->uid));
+    result->uid_bytes = parser.uid_bytes;
+    result->uid_len = parser.uid_len;
+    result->has_dump = parser.has_dump;
+    result->failed_sectors = parser.failed_sectors;
+}
+
+// The parser this replaced: the whole file in memory, strstr() per key and
+// a 16-conversion sscanf() per block
+static bool legacy_block(const char* buffer, uint8_t block, uint8_t* out) {
+    char key[16];
+    snprintf(key, sizeof(key), "Block_%d:", block);
+    const char* line = strstr(buffer, key);
+    if(!line) return false;
+
+    unsigned int b[16];
+    if(sscanf(
+           line + strlen(key),
+           " %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X %02X",
+           &b[0], &b[1], &b[2], &b[3], &b[4], &b[5], &b[6], &b[7],
+           &b[8], &b[9], &b[10], &b[11], &b[12], &b[13], &b[14], &b[15]) != 16) {
+        return false;
+    }
+    for(int i = 0; i < 16; i++) out[i] = b[i];
+    return true;
+}
+
+static void parse_legacy(const char* data, size_t size, ParseResult* result) {
+    char* buffer = malloc(size + 1);
+    memcpy(buffer, data, size);
+    buffer[size] = '\0';
+    memset(result, 0, sizeof(ParseResult));
+
+    const char* uid_line = strstr(buffer, "UID:");
+    unsigned int u[4];
+    if(uid_line && sscanf(uid_line, "UID: %02X %02X %02X %02X", &u[0], &u[1], &u[2], &u[3]) == 4) {
+        for(int i = 0; i < 4; i++) result->uid[i] = u[i];
+        result->uid_bytes = 4;
+    }
+    const char* uid_len_line = strstr(buffer, "UID_len:");
+    int len;
+    if(uid_len_line && sscanf(uid_len_line, "UID_len: %d", &len) == 1) result->uid_len = len;
+
+    static const uint8_t filament[] = {1, 2, 4, 5, 6};
+    for(size_t i = 0; i < sizeof(filament); i++) {
+        if(legacy_block(buffer, filament[i], result->blocks[filament[i]])) {
+            result->block_mask |= 1ull << filament[i];
+        }
+    }
+    const char* failed_line = strstr(buffer, "Sectors_failed:");
+    unsigned int failed;
+    if(failed_line && sscanf(failed_line, "Sectors_failed: %04X", &failed) == 1) {
+        for(uint8_t block = 0; block < BLOCK_COUNT; block++) {
+            if(legacy_block(buffer, block, result->blocks[block])) {
+                result->block_mask |= 1ull << block;
+            }
+        }
+        result->failed_sectors = failed;
+        result->has_dump = true;
+    }
+    result->ok = true;
+    free(buffer);
+}
+
+// ============================================
+// Sample files
+// ============================================
+static size_t append_block(char* out, size_t pos, uint8_t block) {
+    pos += sprintf(out + pos, "Block_%d:", block);
+    for(int i = 0; i < 16; i++) pos += sprintf(out + pos, " %02X", (unsigned)(rng_next() >> 56));
+    return pos + sprintf(out + pos, "\n");
+}
+
+// A file as the app wrote it before v2: the filament blocks, or a full dump
+static size_t sample_file(char* out, bool dump) {
+    size_t pos = sprintf(out, "Filetype: Bambu Tag\nVersion: 1\nUID: 04 A1 B2 C3\nUID_len: 7\n");
+    if(dump) {
+        pos += sprintf(out + pos, "Sectors_failed: 0000\n");
+        for(uint8_t block = 0; block < BLOCK_COUNT; block++) pos = append_block(out, pos, block);
+    } else {
+        static const uint8_t filament[] = {1, 2, 4, 5, 6};
+        for(size_t i = 0; i < sizeof(filament); i++) pos = append_block(out, pos, filament[i]);
+    }
+    return pos;
+}
+
+// ============================================
+// Benchmark
+// ============================================
+static void bench_one(const char* name, const char* data, size_t size, size_t rounds) {
+    ParseResult result, legacy_result;
+
+    // Both read the same UID and blocks from the files the app used to write
+    parse_legacy(data, size, &legacy_result);
+    parse_streaming(data, size, APP_CHUNK, &result);
+    if(!result.ok || result.block_mask != legacy_result.block_mask ||
+       memcmp(result.blocks, legacy_result.blocks, sizeof(result.blocks)) != 0 ||
+       memcmp(result.uid, legacy_result.uid, 4) != 0 || result.uid_len != legacy_result.uid_len) {
+        fprintf(stderr, "%s: parsers disagree\n", name);
+        exit(1);
+    }
+
+    uint64_t start = now_ns();
+    for(size_t i = 0; i < rounds; i++) parse_legacy(data, size, &result);
+    double legacy = (double)(now_ns() - start) / rounds;
+
+    start = now_ns();
+    for(size_t i = 0; i < rounds; i++) parse_streaming(data, size, APP_CHUNK, &result);
+    double streaming = (double)(now_ns() - start) / rounds;
+
+    printf(
+        "%-9s %5zu bytes: legacy %8.0f ns (%zu bytes held), streaming %7.0f ns "
+        "(%zu bytes held), %4.1fx\n",
+        name,
+        size,
+        legacy,
+        size + 1,
+        streaming,
+        sizeof(BtagTextParser) + APP_CHUNK,
+        legacy / streaming);
+}
+
+static int cmd_bench(size_t rounds) {
+    char* data = malloc(MAX_FILE);
+
+    bench_one("filament", data, sample_file(data, false), rounds);
+    bench_one("dump", data, sample_file(data, true), rounds / 10 ? rounds / 10 : 1);
+    free(data);
+    return 0;
+}
+
+// ============================================
+// Fuzz
+// ============================================
+static bool same_result(const ParseResult* a, const ParseResult* b) {
+    return memcmp(a, b, sizeof(ParseResult)) == 0;
+}
+
+// Every chunk size must give the result of parsing the file in one piece
+static bool check_chunking(const char* data, size_t size, ParseResult* whole) {
+    static const size_t chunks[] = {1, 2, 3, 7, 16, 79, 80, 81, APP_CHUNK};
+    ParseResult result;
+
+    parse_streaming(data, size, size ? size : 1, whole);
+    for(size_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++) {
+        parse_streaming(data, size, chunks[i], &result);
+        if(!same_result(whole, &result)) {
+            fprintf(stderr, "chunk size %zu disagrees with a single feed\n", chunks[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+// Byte flips, line-breaking characters, cuts and repeats
+static size_t mutate(char* data, size_t size, size_t capacity) {
+    static const char interesting[] = {'\n', '\r', ':', ' ', '?', '#', '\0', 'G', '0', 'f'};
+    unsigned edits = 1 + rng_next() % 4;
+
+    for(unsigned e = 0; e < edits && size > 0; e++) {
+        size_t at = rng_next() % size;
+        switch(rng_next() % 5) {
+        case 0:
+            data[at] ^= 1 << (rng_next() % 8);
+            break;
+        case 1:
+            data[at] = interesting[rng_next() % sizeof(interesting)];
+            break;
+        case 2:
+            size = at;
+            break;
+        case 3: {
+            size_t length = 1 + rng_next() % 200;
+            if(at + length > size) length = size - at;
+            if(size + length <= capacity) {
+                memmove(data + at + length, data + at, size - at);
+                size += length;
+            }
+            break;
+        }
+        default: {
+            size_t length = 1 + rng_next() % 64;
+            if(at + length > size) length = size - at;
+            memmove(data + at, data + at + length, size - at - length);
+            size -= length;
+            break;
+        }
+        }
+    }
+    return size;
+}
+
+// Seeds named bad_* must fail, the others must parse. Each seed is then
+// mutated rounds times.
+static int cmd_fuzz(char** paths, int count, size_t rounds) {
+    char* seed = malloc(MAX_FILE);
+    char* data = malloc(MAX_FILE);
+    ParseResult result;
+    size_t runs = 0, accepted = 0;
+
+    for(int p = 0; p < count; p++) {
+        size_t seed_size = read_file(paths[p], seed, MAX_FILE / 2);
+        const char* name = strrchr(paths[p], '/');
+        bool expect_ok = strncmp(name ? name + 1 : paths[p], "bad_", 4) != 0;
+
+        if(!check_chunking(seed, seed_size, &result)) return 1;
+        if(result.ok != expect_ok) {
+            fprintf(stderr, "%s: expected %s, line %u\n", paths[p], expect_ok ? "ok" : "failure", result.line);
+            return 1;
+        }
+
+        for(size_t r = 0; r < rounds; r++) {
+            memcpy(data, seed, seed_size);
+            size_t size = mutate(data, seed_size, MAX_FILE);
+            if(!check_chunking(data, size, &result)) {
+                fwrite(data, 1, size, stderr);
+                return 1;
+            }
+            accepted += result.ok;
+            runs++;
+        }
+    }
+    printf("%d seeds ok, %zu mutations, %zu still parsed\n", count, runs, accepted);
+    free(seed);
+    free(data);
+    return 0;
+}
+
+// ============================================
+// Main
+// ============================================
+static void usage(const char* argv0) {
+    fprintf(
+        stderr,
+        "usage: %s bench [rounds]                legacy parser against btag_text\n"
+        "       %s fuzz [-n rounds] FILE...      check seeds, then mutate each\n",
+        argv0,
+        argv0);
+}
+
+int main(int argc, char** argv) {
+    if(argc >= 2 && strcmp(argv[1], "bench") == 0) {
+        size_t rounds = argc > 2 ? strtoul(argv[2], NULL, 10) : 100000;
+        return cmd_bench(rounds ? rounds : 1);
+    }
+    if(argc >= 3 && strcmp(argv[1], "fuzz") == 0) {
+        size_t rounds = 10000;
+        int first = 2;
+        if(strcmp(argv[2], "-n") == 0 && argc >= 5) {
+            rounds = strtoul(argv[3], NULL, 10);
+            first = 4;
+        }
+        return cmd_fuzz(argv + first, argc - first, rounds);
+    }
+    usage(argv[0]);
+    return 2;
+}
@@ -0,0 +1,253 @@
+/**
+ * @file keygen_x8.c
+ * @brief Multi-buffer key derivation for the host key generator
+ * @author Tai Nguyen <taiducnguyen.drexel@gmail.com>
+ */
+
+#include "keygen_x8.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KEYGEN_HAVE_AVX2 1
+#endif
+
+// Context string for HKDF-Expand, as in bambu_crypto.c (includes null terminator)
+static const uint8_t KEYGEN_CONTEXT[] = "RFID-A";
+#define KEYGEN_CONTEXT_LEN 7
+
+static const uint32_t SHA256_IV[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+static uint32_t load_be32(const uint8_t* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void store_be32(uint8_t* p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+// ============================================
+// Scalar backend
+// ============================================
+static void compress_scalar(
+    uint32_t state[KEYGEN_LANES][8],
+    const uint8_t block[KEYGEN_LANES][BAMBU_SHA256_BLOCK_LEN]) {
+    for(int lane = 0; lane < KEYGEN_LANES; lane++) {
+        bambu_sha256_compress(state[lane], block[lane]);
+    }
+}
+
+static const KeygenBackend backend_scalar = {"scalar", compress_scalar};
+
+const KeygenBackend* keygen_backend_scalar(void) {
+    return &backend_scalar;
+}
+
+// ============================================
+// AVX2 backend
+// ============================================
+#ifdef KEYGEN_HAVE_AVX2
+static const uint32_t SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define KEYGEN_AVX2 __attribute__((target("avx2")))
+
+#define ROR8(x, n) _mm256_or_si256(_mm256_srli_epi32((x), (n)), _mm256_slli_epi32((x), 32 - (n)))
+#define XOR8(a, b) _mm256_xor_si256((a), (b))
+#define ADD8(a, b) _mm256_add_epi32((a), (b))
+
+// Eight independent compressions, each 32-bit lane is one SHA-256 instance
+KEYGEN_AVX2 static void compress_avx2(
+    uint32_t state[KEYGEN_LANES][8],
+    const uint8_t block[KEYGEN_LANES][BAMBU_SHA256_BLOCK_LEN]) {
+    uint32_t lanes[KEYGEN_LANES];
+    __m256i s[8];
+    __m256i w[16];
+
+    for(int k = 0; k < 8; k++) {
+        for(int lane = 0; lane < KEYGEN_LANES; lane++) lanes[lane] = state[lane][k];
+        s[k] = _mm256_loadu_si256((const __m256i*)lanes);
+    }
+    for(int t = 0; t < 16; t++) {
+        for(int lane = 0; lane < KEYGEN_LANES; lane++) lanes[lane] = load_be32(&block[lane][t * 4]);
+        w[t] = _mm256_loadu_si256((const __m256i*)lanes);
+    }
+
+    __m256i a = s[0], b = s[1], c = s[2], d = s[3];
+    __m256i e = s[4], f = s[5], g = s[6], h = s[7];
+
+    for(int i = 0; i < 64; i++) {
+        __m256i wi;
+        if(i < 16) {
+            wi = w[i];
+        } else {
+            __m256i w15 = w[(i - 15) & 15];
+            __m256i w2 = w[(i - 2) & 15];
+            __m256i s0 = XOR8(XOR8(ROR8(w15, 7), ROR8(w15, 18)), _mm256_srli_epi32(w15, 3));
+            __m256i s1 = XOR8(XOR8(ROR8(w2, 17), ROR8(w2, 19)), _mm256_srli_epi32(w2, 10));
+            wi = ADD8(ADD8(w[i & 15], s0), ADD8(w[(i - 7) & 15], s1));
+            w[i & 15] = wi;
+        }
+
+        __m256i sigma1 = XOR8(XOR8(ROR8(e, 6), ROR8(e, 11)), ROR8(e, 25));
+        __m256i ch = XOR8(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+        __m256i t1 = ADD8(ADD8(h, sigma1), ADD8(ch, ADD8(_mm256_set1_epi32(SHA256_K[i]), wi)));
+        __m256i sigma0 = XOR8(XOR8(ROR8(a, 2), ROR8(a, 13)), ROR8(a, 22));
+        __m256i maj = XOR8(
+            XOR8(_mm256_and_si256(a, b), _mm256_and_si256(a, c)), _mm256_and_si256(b, c));
+        __m256i t2 = ADD8(sigma0, maj);
+        h = g;
+        g = f;
+        f = e;
+        e = ADD8(d, t1);
+        d = c;
+        c = b;
+        b = a;
+        a = ADD8(t1, t2);
+    }
+
+    s[0] = ADD8(s[0], a);
+    s[1] = ADD8(s[1], b);
+    s[2] = ADD8(s[2], c);
+    s[3] = ADD8(s[3], d);
+    s[4] = ADD8(s[4], e);
+    s[5] = ADD8(s[5], f);
+    s[6] = ADD8(s[6], g);
+    s[7] = ADD8(s[7], h);
+
+    for(int k = 0; k < 8; k++) {
+        _mm256_storeu_si256((__m256i*)lanes, s[k]);
+        for(int lane = 0; lane < KEYGEN_LANES; lane++) state[lane][k] = lanes[lane];
+    }
+}
+
+static const KeygenBackend backend_avx2 = {"avx2", compress_avx2};
+#endif
+
+const KeygenBackend* keygen_backend_avx2(void) {
+#ifdef KEYGEN_HAVE_AVX2
+    if(__builtin_cpu_supports("avx2")) return &backend_avx2;
+#endif
+    return NULL;
+}
+
+const KeygenBackend* keygen_backend_best(void) {
+    const KeygenBackend* backend = keygen_backend_avx2();
+    return backend ? backend : keygen_backend_scalar();
+}
+
+// ============================================
+// Derivation
+// ============================================
+// Pad the len-byte message at the start of block, which follows one 64-byte
+// HMAC pad block
+static void pad_block(uint8_t block[BAMBU_SHA256_BLOCK_LEN], size_t len) {
+    block[len] = 0x80;
+    memset(&block[len + 1], 0, BAMBU_SHA256_BLOCK_LEN - 4 - (len + 1));
+    store_be32(&block[BAMBU_SHA256_BLOCK_LEN - 4], (uint32_t)(BAMBU_SHA256_BLOCK_LEN + len) * 8);
+}
+
+static void state_to_bytes(const uint32_t state[8], uint8_t* out) {
+    for(int k = 0; k < 8; k++) store_be32(&out[k * 4], state[k]);
+}
+
+// HMAC of one single-block message per lane: the inner and outer pad blocks
+// are already absorbed in inner/outer
+static void hmac_x8(
+    const KeygenBackend* backend,
+    const uint32_t inner[KEYGEN_LANES][8],
+    const uint32_t outer[KEYGEN_LANES][8],
+    uint8_t block[KEYGEN_LANES][BAMBU_SHA256_BLOCK_LEN],
+    const size_t* msg_lens,
+    uint8_t digest[KEYGEN_LANES][BAMBU_SHA256_DIGEST_LEN]) {
+    uint32_t state[KEYGEN_LANES][8];
+
+    memcpy(state, inner, sizeof(state));
+    for(int lane = 0; lane < KEYGEN_LANES; lane++) pad_block(block[lane], msg_lens[lane]);
+    backend->compress(state, (const uint8_t(*)[BAMBU_SHA256_BLOCK_LEN])block);
+
+    for(int lane = 0; lane < KEYGEN_LANES; lane++) {
+        state_to_bytes(state[lane], block[lane]);
+        pad_block(block[lane], BAMBU_SHA256_DIGEST_LEN);
+    }
+    memcpy(state, outer, sizeof(state));
+    backend->compress(state, (const uint8_t(*)[BAMBU_SHA256_BLOCK_LEN])block);
+
+    for(int lane = 0; lane < KEYGEN_LANES; lane++) state_to_bytes(state[lane], digest[lane]);
+}
+
+void keygen_derive(
+    const KeygenBackend* backend,
+    const uint8_t uids[][BAMBU_UID_MAX_LEN],
+    const uint8_t* uid_lens,
+    size_t count,
+    BambuKeys* keys) {
+    uint8_t block[KEYGEN_LANES][BAMBU_SHA256_BLOCK_LEN];
+    uint32_t inner[KEYGEN_LANES][8];
+    uint32_t outer[KEYGEN_LANES][8];
+    uint8_t digest[KEYGEN_LANES][BAMBU_SHA256_DIGEST_LEN];
+    uint8_t okm[KEYGEN_LANES][BAMBU_EXPAND_BLOCKS * BAMBU_SHA256_DIGEST_LEN];
+    size_t msg_lens[KEYGEN_LANES];
+
+    if(count == 0) return;
+    if(count > KEYGEN_LANES) count = KEYGEN_LANES;
+
+    // Extract: PRK = HMAC(master, uid). Unused lanes repeat the last UID.
+    const BambuHmacKey* master = bambu_master_hmac();
+    for(int lane = 0; lane < KEYGEN_LANES; lane++) {
+        size_t src = (size_t)lane < count ? (size_t)lane : count - 1;
+        memcpy(block[lane], uids[src], uid_lens[src]);
+        msg_lens[lane] = uid_lens[src];
+        memcpy(inner[lane], master->inner, sizeof(inner[lane]));
+        memcpy(outer[lane], master->outer, sizeof(outer[lane]));
+    }
+    hmac_x8(backend, inner, outer, block, msg_lens, digest);
+
+    // Key the PRK once for all three expand blocks
+    for(int pad = 0; pad < 2; pad++) {
+        uint32_t(*state)[8] = pad == 0 ? inner : outer;
+        for(int lane = 0; lane < KEYGEN_LANES; lane++) {
+            memset(block[lane], pad == 0 ? 0x36 : 0x5c, BAMBU_SHA256_BLOCK_LEN);
+            for(int i = 0; i < BAMBU_SHA256_DIGEST_LEN; i++) block[lane][i] ^= digest[lane][i];
+            memcpy(state[lane], SHA256_IV, sizeof(SHA256_IV));
+        }
+        backend->compress(state, (const uint8_t(*)[BAMBU_SHA256_BLOCK_LEN])block);
+    }
+
+    // Expand: T(i) = HMAC(PRK, T(i-1) || context || i)
+    for(uint8_t i = 1; i <= BAMBU_EXPAND_BLOCKS; i++) {
+        for(int lane = 0; lane < KEYGEN_LANES; lane++) {
+            size_t len = 0;
+            if(i > 1) {
+                memcpy(block[lane], &okm[lane][(i - 2) * BAMBU_SHA256_DIGEST_LEN], BAMBU_SHA256_DIGEST_LEN);
+                len = BAMBU_SHA256_DIGEST_LEN;
+            }
+            memcpy(&block[lane][len], KEYGEN_CONTEXT, KEYGEN_CONTEXT_LEN);
+            len += KEYGEN_CONTEXT_LEN;
+            block[lane][len++] = i;
+            msg_lens[lane] = len;
+        }
+        hmac_x8(backend, inner, outer, block, msg_lens, digest);
+        for(int lane = 0; lane < KEYGEN_LANES; lane++) {
+            memcpy(&okm[lane][(i - 1) * BAMBU_SHA256_DIGEST_LEN], digest[lane], BAMBU_SHA256_DIGEST_LEN);
+        }
+    }
+
+    for(size_t lane = 0; lane < count; lane++) {
+        memcpy(keys[lane].keys, okm[lane], sizeof(BambuKeys));
+    }
+}
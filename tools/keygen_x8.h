@@ -0,0 +1,39 @@
+/**
+ * @file keygen_x8.h
+ * @brief Multi-buffer key derivation for the host key generator
+ * @author Tai Nguyen <taiducnguyen.drexel@gmail.com>
+ */
+
+#pragma once
+
+#include "bambu_crypto.h"
+
+// UIDs derived together, one per 32-bit lane of an AVX2 register
+#define KEYGEN_LANES 8
+
+// SHA-256 compression of one block in each lane. state is [lane][word].
+typedef void (*KeygenCompressFn)(
+    uint32_t state[KEYGEN_LANES][8],
+    const uint8_t block[KEYGEN_LANES][BAMBU_SHA256_BLOCK_LEN]);
+
+typedef struct {
+    const char* name;
+    KeygenCompressFn compress;
+} KeygenBackend;
+
+// Portable backend, bambu_sha256_compress() once per lane
+const KeygenBackend* keygen_backend_scalar(void);
+
+// AVX2 backend, NULL if the CPU or the build has no AVX2
+const KeygenBackend* keygen_backend_avx2(void);
+
+// Fastest backend this CPU runs
+const KeygenBackend* keygen_backend_best(void);
+
+// Derive the keys of up to KEYGEN_LANES UIDs, the same as calculate_all_keys()
+void keygen_derive(
+    const KeygenBackend* backend,
+    const uint8_t uids[][BAMBU_UID_MAX_LEN],
+    const uint8_t* uid_lens,
+    size_t count,
+    BambuKeys* keys);